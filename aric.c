@@ -2,7 +2,7 @@
 // 03-Dec-15  Markku-Juhani O. Saarinen <mjos@iki.fi>
 // Dynamic arithmetic coding / decoding routines.
 
-#include "wee.h"
+#include "weei.h"
 
 // Initialize frequencies to "balanced".
 
@@ -16,17 +16,16 @@ void aric_freqinit(uint32_t freq[][2], size_t bits)
     }
 }
 
-// Divide frequencies in half, "de-emphasizing past".
+// Divide frequencies in half, "de-emphasizing past". Rounds up, so that
+// a count never drops to zero and leaves its bit uncodable.
 
 void aric_freqhalf(uint32_t freq[][2], size_t bits)
 {
     size_t i;
 
     for (i = 0; i < (1 << bits); i++) {
-        if (freq[i][0] > 0)
-            freq[i][0] >>= 1;
-        if (freq[i][1] > 0)
-            freq[i][1] >>= 1;
+        freq[i][0] = (freq[i][0] + 1) >> 1;
+        freq[i][1] = (freq[i][1] + 1) >> 1;
     }
 }
 
@@ -47,6 +46,30 @@ void aric_addfreq(uint32_t freq[][2], size_t bits, uint32_t x)
     }
 }
 
+// Update like aric_addfreq(), but halve the counts of any node whose total
+// exceeds "lim"; recent statistics then outweigh old ones (lim < 2^31).
+
+void aric_addfreql(uint32_t freq[][2], size_t bits, uint32_t x, uint32_t lim)
+{
+    uint32_t i, b, t;
+
+    for (i = 0; i < bits; i++) {
+        b = 1 << i;
+        if (x & b) {
+            freq[x][1]++;               // bit is "1"
+            t = x;
+            x -= b;                     // clear it
+        } else {
+            t = x + b;
+            freq[t][0]++;               // bit is "0"
+        }
+        if (freq[t][0] + freq[t][1] > lim) {
+            freq[t][0] = (freq[t][0] + 1) >> 1;
+            freq[t][1] = (freq[t][1] + 1) >> 1;
+        }
+    }
+}
+
 // Initialize range buffer.
 
 void aric_init_rb(aric_rb_t *rb, void *buf, size_t len, int dec)
@@ -99,13 +122,71 @@ size_t aric_final_out(aric_rb_t *rb)
     return rb->ptr;
 }
 
+// Normalize range and output bits.
+
+static inline int aric_norm_out(aric_rb_t *rb)
+{
+    int i;
+
+    while (rb->l < 0x80000000) {
+        rb->byt <<= 1;
+        rb->byt += (rb->b >> 31) & 1;
+        rb->bit++;
+        if (rb->bit >= 8) {             // full byte ?
+            rb->buf[rb->ptr] = rb->byt & 0xFF;
+
+            // carry propagation
+            for (i = rb->ptr - 1; rb->byt >= 0x100 && i >= 0; i--) {
+                rb->byt >>= 8;
+                rb->byt += (uint32_t) rb->buf[i];
+                rb->buf[i] = rb->byt & 0xFF;
+            }
+            rb->ptr++;
+            if (rb->ptr >= rb->max)     // output buffer overflow
+                return -1;
+            rb->bit = 0;
+            rb->byt = 0x00;
+        }
+
+        rb->b <<= 1;                    // shift left
+        rb->l <<= 1;                    // double range
+    }
+
+    return 0;
+}
+
+// Normalize range and fetch input bits.
+
+static inline int aric_norm_in(aric_rb_t *rb)
+{
+    while (rb->l < 0x80000000) {
+        rb->v <<= 1;                    // fetch new bit
+        rb->v += (rb->byt >> 7) & 1;
+        rb->byt <<= 1;
+        rb->bit++;
+        if (rb->bit >= 8) {
+            if (rb->ptr >= rb->max) {   // too much read!
+                rb->ptr = rb->max + 1;  // flag it
+                return -1;
+            }
+            rb->bit = 0;
+            rb->byt = rb->buf[rb->ptr++];
+        }
+
+        rb->b <<= 1;                    // shift left
+        rb->l <<= 1;                    // double range
+    }
+
+    return 0;
+}
+
 // Encode a "bits"-sized word to output stream.
 
 int aric_enc(aric_rb_t *rb,             // output stream
     uint32_t iwrd,                      // input word to be encoded
     uint32_t freq[][2], size_t bits)    // binary frequencies
 {
-    int i, ibit;
+    int ibit;
     uint32_t tree;                      // input word masked
     uint32_t f;                         // select midpoint
 
@@ -115,7 +196,7 @@ int aric_enc(aric_rb_t *rb,             // output stream
         if (freq == NULL) {
             f = rb->l >> 1;
         } else {
-            tree = (iwrd & (~1 << ibit)) | (1 << ibit);
+            tree = (iwrd & (~1u << ibit)) | (1u << ibit);
             f = ((uint64_t) rb->l) * ((uint64_t) freq[tree][0]) /
                 ((uint64_t) freq[tree][0] + freq[tree][1]);
         }
@@ -129,30 +210,8 @@ int aric_enc(aric_rb_t *rb,             // output stream
                 rb->byt++;              // carry!
         }
 
-        // normalize and output bits
-        while (rb->l < 0x80000000) {
-            rb->byt <<= 1;
-            rb->byt += (rb->b >> 31) & 1;
-            rb->bit++;
-            if (rb->bit >= 8) {         // full byte ?
-                rb->buf[rb->ptr] = rb->byt & 0xFF;
-
-                // carry propagation
-                for (i = rb->ptr - 1; rb->byt >= 0x100 && i >= 0; i--) {
-                    rb->byt >>= 8;
-                    rb->byt += (uint32_t) rb->buf[i];
-                    rb->buf[i] = rb->byt & 0xFF;
-                }
-                rb->ptr++;
-                if (rb->ptr >= rb->max) // output buffer overflow
-                    return -1;
-                rb->bit = 0;
-                rb->byt = 0x00;
-            }
-
-            rb->b <<= 1;                // shift left
-            rb->l <<= 1;                // double range
-        }
+        if (aric_norm_out(rb))         // normalize and output bits
+            return -1;
     }
 
     return 0;
@@ -174,7 +233,7 @@ uint32_t aric_dec(aric_rb_t *rb,        // input range buffer
         if (freq == NULL) {
             f = rb->l >> 1;
         } else {
-            tree = (owrd & (~1 << obit)) | (1 << obit);
+            tree = (owrd & (~1u << obit)) | (1u << obit);
             f = ((uint64_t) rb->l) * ((uint64_t) freq[tree][0]) /
                 ((uint64_t) freq[tree][0] + freq[tree][1]);
         }
@@ -187,23 +246,449 @@ uint32_t aric_dec(aric_rb_t *rb,        // input range buffer
             owrd |= 1 << obit;          // set the bit
         }
 
-        while (rb->l < 0x80000000) {
-            rb->v <<= 1;                // fetch new bit
-            rb->v += (rb->byt >> 7) & 1;
-            rb->byt <<= 1;
-            rb->bit++;
-            if (rb->bit >= 8) {
-                if (rb->ptr >= rb->max) // too much read!
-                    return ~0;          // return error
-                rb->bit = 0;
-                rb->byt = rb->buf[rb->ptr++];
-            }
+        if (aric_norm_in(rb))          // normalize and fetch bits
+            return ~0;                  // return error
+    }
+
+    return owrd;
+}
+
+
+// Code a word with frequency counts and update them in the same walk of
+// the tree, like aric_enc() + aric_addfreql(). Each node is visited once,
+// so this codes exactly the same bits. Specialized for the widths used.
+
+static inline void aric_cntupd(uint32_t cnt[2], uint32_t x, uint32_t lim)
+{
+    cnt[x]++;
+    if (cnt[0] + cnt[1] > lim) {
+        cnt[0] = (cnt[0] + 1) >> 1;
+        cnt[1] = (cnt[1] + 1) >> 1;
+    }
+}
+
+static inline int aric_encf_k(aric_rb_t *rb, uint32_t iwrd,
+    uint32_t freq[][2], int bits, uint32_t lim)
+{
+    uint32_t f, x, tree;
+    int ibit;
+
+    for (ibit = bits - 1; ibit >= 0; ibit--) {
+
+        tree = (iwrd & (~1u << ibit)) | (1u << ibit);
+        f = ((uint64_t) rb->l) * ((uint64_t) freq[tree][0]) /
+            ((uint64_t) freq[tree][0] + freq[tree][1]);
+        x = (iwrd >> ibit) & 1;
+        aric_cntupd(freq[tree], x, lim);
+
+        if (x == 0) {
+            rb->l = f;                  // 0 bit; lower part
+        } else {
+            rb->b += f;                 // 1 bit; higher part
+            rb->l -= f;                 // flip range to upper half
+            if (rb->b < f)              // overflow ?
+                rb->byt++;              // carry!
+        }
+
+        if (aric_norm_out(rb))
+            return -1;
+    }
+
+    return 0;
+}
+
+static inline uint32_t aric_decf_k(aric_rb_t *rb,
+    uint32_t freq[][2], int bits, uint32_t lim)
+{
+    uint32_t f, x, owrd, tree;
+    int obit;
+
+    owrd = 0;
+    for (obit = bits - 1; obit >= 0; obit--) {
 
-            rb->b <<= 1;                // shift left
-            rb->l <<= 1;                // double range
+        tree = owrd | (1 << obit);
+        f = ((uint64_t) rb->l) * ((uint64_t) freq[tree][0]) /
+            ((uint64_t) freq[tree][0] + freq[tree][1]);
+        x = rb->v - rb->b >= f;
+        aric_cntupd(freq[tree], x, lim);
+
+        if (x == 0) {
+            rb->l = f;                  // 0 bit; lower part
+        } else {
+            rb->b += f;                 // 1 bit; higher part
+            rb->l -= f;                 // flip range to upper half
+            owrd |= 1 << obit;          // set the bit
         }
+
+        if (aric_norm_in(rb))
+            return ~0;
     }
 
     return owrd;
 }
 
+// Encode / decode a byte or a 6-bit word and update the counts.
+
+int aric_encf8(aric_rb_t *rb, uint32_t iwrd, uint32_t freq[][2],
+    uint32_t lim)
+{
+    return aric_encf_k(rb, iwrd, freq, 8, lim);
+}
+
+uint32_t aric_decf8(aric_rb_t *rb, uint32_t freq[][2], uint32_t lim)
+{
+    return aric_decf_k(rb, freq, 8, lim);
+}
+
+int aric_encf6(aric_rb_t *rb, uint32_t iwrd, uint32_t freq[][2],
+    uint32_t lim)
+{
+    return aric_encf_k(rb, iwrd, freq, 6, lim);
+}
+
+uint32_t aric_decf6(aric_rb_t *rb, uint32_t freq[][2], uint32_t lim)
+{
+    return aric_decf_k(rb, freq, 6, lim);
+}
+
+// Adaptive probabilities are 16-bit states: a 12-bit probability of a
+// zero bit and a 4-bit count that selects the adaptation shift, so that
+// a fresh context learns about as fast as a frequency count and then
+// settles to a fixed rate. No divisions are needed.
+
+#define ARIC_PBITS 12
+
+static const uint8_t aric_pshift[0x10] = {
+    1, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4
+};
+
+// Update probability state s with bit.
+
+static inline uint16_t aric_pupd(uint16_t s, int bit)
+{
+    uint32_t p, n;
+
+    p = s >> 4;
+    n = s & 0xF;
+    if (bit)
+        p -= p >> aric_pshift[n];
+    else
+        p += ((1 << ARIC_PBITS) - p) >> aric_pshift[n];
+    if (n < 0xF)
+        n++;
+
+    return (p << 4) | n;
+}
+
+// Initialize probabilities to "balanced".
+
+void aric_probinit(uint16_t prob[], size_t bits)
+{
+    size_t i;
+
+    for (i = 0; i < (1 << bits); i++)
+        prob[i] = (1 << (ARIC_PBITS - 1)) << 4;
+}
+
+// The probability coder renormalizes a byte at a time. A carry can only
+// reach bytes not yet written: the last byte below 0xFF is cached and
+// any following 0xFF bytes are counted as pending (as in LZMA), so the
+// buffer is never revisited. The leading byte is always zero; skip it.
+
+// Initialize a range buffer for the byte-oriented coder.
+
+void aric_init_rc(aric_rb_t *rb, void *buf, size_t len, int dec)
+{
+    rb->buf = buf;
+    rb->max = len;
+    rb->ptr = 0;
+    rb->bit = 1;                        // leading zero byte not written
+    rb->byt = 0;                        // cached byte
+    rb->pnd = 1;                        // cached byte and pending 0xFFs
+    rb->lo = 0;                         // low end (33 bits)
+    rb->b = 0;
+    rb->l = 0xFFFFFFFF;                 // range
+    rb->v = 0;                          // input code
+
+    if (dec) {
+        for (rb->ptr = 0; rb->ptr < 4 && rb->ptr < len; rb->ptr++) {
+            rb->v <<= 8;
+            rb->v += (uint32_t) rb->buf[rb->ptr];
+        }
+    }
+}
+
+// Restart the byte-oriented coder at the current position, e.g. after
+// aric_final_rc(). The decoder flags a short buffer like an underrun.
+
+void aric_restart_rc(aric_rb_t *rb, int dec)
+{
+    size_t ptr;
+    int i;
+
+    ptr = rb->ptr;
+    aric_init_rc(rb, rb->buf, rb->max, 0);
+    rb->ptr = ptr;
+
+    if (dec) {
+        for (i = 0; i < 4; i++) {
+            if (rb->ptr >= rb->max) {   // too much read!
+                rb->ptr = rb->max + 1;  // flag it
+                break;
+            }
+            rb->v = (rb->v << 8) | rb->buf[rb->ptr++];
+        }
+    }
+}
+
+// Move the top byte of the low end out; resolves cached bytes.
+
+static inline int aric_shift_low(aric_rb_t *rb)
+{
+    uint32_t c;
+
+    if ((uint32_t) rb->lo < 0xFF000000 || (rb->lo >> 32) != 0) {
+        c = (uint32_t) (rb->lo >> 32);  // carry
+        if (rb->ptr + rb->pnd > rb->max)
+            return -1;                  // output buffer overflow
+        if (rb->bit) {
+            rb->bit = 0;                // skip the leading byte
+        } else {
+            rb->buf[rb->ptr++] = (rb->byt + c) & 0xFF;
+        }
+        while (--rb->pnd > 0)
+            rb->buf[rb->ptr++] = (0xFF + c) & 0xFF;
+        rb->byt = (rb->lo >> 24) & 0xFF;
+    }
+    rb->pnd++;
+    rb->lo = (rb->lo & 0x00FFFFFF) << 8;
+
+    return 0;
+}
+
+// Normalize range, output bytes.
+
+static inline int aric_norm_rc_out(aric_rb_t *rb)
+{
+    while (rb->l < 0x01000000) {
+        rb->l <<= 8;
+        if (aric_shift_low(rb))
+            return -1;
+    }
+
+    return 0;
+}
+
+// Normalize range, fetch input bytes.
+
+static inline int aric_norm_rc_in(aric_rb_t *rb)
+{
+    while (rb->l < 0x01000000) {
+        if (rb->ptr >= rb->max) {       // too much read!
+            rb->ptr = rb->max + 1;      // flag it
+            return -1;
+        }
+        rb->l <<= 8;
+        rb->v = (rb->v << 8) | rb->buf[rb->ptr++];
+    }
+
+    return 0;
+}
+
+// Finalize output of the byte-oriented coder.
+
+size_t aric_final_rc(aric_rb_t *rb)
+{
+    int i;
+
+    for (i = 0; i < 5; i++) {
+        if (aric_shift_low(rb))
+            break;
+    }
+
+    return rb->ptr;
+}
+
+// Code "bits" bits of a word with adaptive probabilities. The state is
+// kept in registers and the coder only renormalizes when the range gets
+// short, which is about once a byte. Called with a constant width, the
+// loop is unrolled; the wrappers below provide the widths used.
+
+static inline int aric_encp_k(aric_rb_t *rb, uint32_t iwrd,
+    uint16_t prob[], int bits)
+{
+    uint32_t l, f, x, tree;
+    uint64_t lo;
+    int ibit;
+
+    l = rb->l;
+    lo = rb->lo;
+    tree = 1;
+    for (ibit = bits - 1; ibit >= 0; ibit--) {
+
+        x = (iwrd >> ibit) & 1;
+        f = (l >> ARIC_PBITS) * (prob[tree] >> 4);
+        prob[tree] = aric_pupd(prob[tree], x);
+        tree = (tree << 1) | x;
+
+        if (x == 0) {
+            l = f;                      // 0 bit; lower part
+        } else {
+            lo += f;                    // 1 bit; higher part
+            l -= f;
+        }
+
+        if (l < 0x01000000) {
+            rb->l = l;
+            rb->lo = lo;
+            if (aric_norm_rc_out(rb))
+                return -1;
+            l = rb->l;
+            lo = rb->lo;
+        }
+    }
+    rb->l = l;
+    rb->lo = lo;
+
+    return 0;
+}
+
+static inline uint32_t aric_decp_k(aric_rb_t *rb,
+    uint16_t prob[], int bits)
+{
+    uint32_t l, v, f, x, tree;
+    int obit;
+
+    l = rb->l;
+    v = rb->v;
+    tree = 1;
+    for (obit = bits - 1; obit >= 0; obit--) {
+
+        f = (l >> ARIC_PBITS) * (prob[tree] >> 4);
+        x = v >= f;
+        prob[tree] = aric_pupd(prob[tree], x);
+        tree = (tree << 1) | x;
+
+        if (x == 0) {
+            l = f;                      // 0 bit; lower part
+        } else {
+            v -= f;                     // 1 bit; higher part
+            l -= f;
+        }
+
+        if (l < 0x01000000) {
+            rb->l = l;
+            rb->v = v;
+            if (aric_norm_rc_in(rb))
+                return ~0;
+            l = rb->l;
+            v = rb->v;
+        }
+    }
+    rb->l = l;
+    rb->v = v;
+
+    return tree & ((1 << bits) - 1);
+}
+
+// Encode a "bits"-sized word with adaptive probabilities (and update).
+
+int aric_encp(aric_rb_t *rb,            // output stream
+    uint32_t iwrd,                      // input word to be encoded
+    uint16_t prob[], size_t bits)       // adaptive probabilities
+{
+    return aric_encp_k(rb, iwrd, prob, bits);
+}
+
+// Decode a word with adaptive probabilities (and update).
+
+uint32_t aric_decp(aric_rb_t *rb,       // input range buffer
+    uint16_t prob[], size_t bits)       // adaptive probabilities
+{
+    return aric_decp_k(rb, prob, bits);
+}
+
+// Encode / decode a 6-bit word with adaptive probabilities.
+
+int aric_encp6(aric_rb_t *rb, uint32_t iwrd, uint16_t prob[])
+{
+    return aric_encp_k(rb, iwrd, prob, 6);
+}
+
+uint32_t aric_decp6(aric_rb_t *rb, uint16_t prob[])
+{
+    return aric_decp_k(rb, prob, 6);
+}
+
+// Encode / decode a byte as two nibbles. prob[] holds 17 trees of 16:
+// the high nibble's at 0, then the low nibble's at 16 * (1 + high).
+
+int aric_encp8(aric_rb_t *rb, uint32_t iwrd, uint16_t prob[])
+{
+    if (aric_encp_k(rb, iwrd >> 4, prob, 4))
+        return -1;
+
+    return aric_encp_k(rb, iwrd & 0xF, &prob[16 + (iwrd & 0xF0)], 4);
+}
+
+uint32_t aric_decp8(aric_rb_t *rb, uint16_t prob[])
+{
+    uint32_t x;
+
+    x = aric_decp_k(rb, prob, 4);
+    if (x == (uint32_t) ~0)
+        return ~0;
+    x <<= 4;
+
+    return x | aric_decp_k(rb, &prob[16 + x], 4);
+}
+
+// Direct bits go up to ARIC_DBITS at a time: one range step splits the
+// range into 2^n equal parts. The range is at least 2^24 between steps,
+// so a part is at least 2^8 wide.
+
+#define ARIC_DBITS 16
+
+// Encode "bits" equiprobable (direct) bits with the byte-oriented coder.
+
+int aric_encd(aric_rb_t *rb, uint32_t iwrd, size_t bits)
+{
+    uint32_t x;
+    int n;
+
+    while (bits > 0) {
+        n = bits < ARIC_DBITS ? bits : ARIC_DBITS;
+        bits -= n;
+        x = (iwrd >> bits) & ((1u << n) - 1);
+        rb->l >>= n;
+        rb->lo += (uint64_t) x * rb->l;
+        if (aric_norm_rc_out(rb))
+            return -1;
+    }
+
+    return 0;
+}
+
+// Decode "bits" equiprobable (direct) bits.
+
+uint32_t aric_decd(aric_rb_t *rb, size_t bits)
+{
+    uint32_t x, owrd;
+    int n;
+
+    owrd = 0;
+    while (bits > 0) {
+        n = bits < ARIC_DBITS ? bits : ARIC_DBITS;
+        bits -= n;
+        rb->l >>= n;
+        x = rb->v / rb->l;
+        if (x >> n)                     // only if the input is corrupt
+            x = (1u << n) - 1;
+        rb->v -= x * rb->l;
+        owrd = (owrd << n) | x;
+        if (aric_norm_rc_in(rb))
+            return ~0;
+    }
+
+    return owrd;
+}
@@ -0,0 +1,68 @@
+#!/bin/bash
+# Large synthetic corpus benchmark with machine-readable results.
+# Usage: bench.sh [TOOL]...   (default ../wee; e.g. ../wee gzip bzip2 xz)
+# BENCH_MB sets the size of each generated file (default 256).
+
+mb=${BENCH_MB:-256}
+dir=bench
+tools=${*:-../wee}
+rev=$(git describe --always --dirty 2>/dev/null || echo unknown)
+
+cc ${CFLAGS:--O2} -o wbench wbench.c || exit 1
+
+# generate the corpus once per size
+mkdir -p $dir
+if [ "$(cat $dir/.mb 2>/dev/null)" != "$mb" ]
+then
+	rm -f $dir/*
+	./wbench gen $dir $mb || exit 1
+	echo $mb > $dir/.mb
+fi
+
+csv=$dir/results.csv
+json=$dir/results.json
+tmp=$dir/tmp
+
+echo "rev,tool,file,size,csize,ctime,cmbs,crss,dtime,dmbs,drss,ok" > $csv
+echo "[" > $json
+
+sep=""
+for zz in $tools
+do
+	zd=`basename $zz`
+	for f in text log table random repeat
+	do
+		# compress and decompress through pipes; times in s, rss in KiB
+		c=( $(./wbench run $dir/$f $tmp.z $zz -c) )
+		cs=$?
+		d=( $(./wbench run $tmp.z $tmp.o $zz -d -c) )
+		len=$(stat -c %s $dir/$f)
+		clen=$(stat -c %s $tmp.z)
+		ok=true
+		if (( cs != 0 )) || ! cmp -s $dir/$f $tmp.o
+		then
+			echo $zd "!!! DECOMPRESSION ERROR WITH" $f "!!!"
+			ok=false
+		fi
+		cmbs=$(awk "BEGIN { printf \"%.2f\", $len / 1e6 / (${c[0]} + 1e-9) }")
+		dmbs=$(awk "BEGIN { printf \"%.2f\", $len / 1e6 / (${d[0]} + 1e-9) }")
+
+		printf "%s\t%-7s %12d %12d %8.2f MB/s %8.2f MB/s %8d KiB\n" \
+			$zd $f $len $clen $cmbs $dmbs ${c[1]}
+
+		echo "$rev,$zd,$f,$len,$clen,${c[0]},$cmbs,${c[1]},${d[0]},$dmbs,${d[1]},$ok" >> $csv
+		printf '%s  {"rev": "%s", "tool": "%s", "file": "%s", ' \
+			"$sep" $rev $zd $f >> $json
+		printf '"size": %d, "csize": %d, ' $len $clen >> $json
+		printf '"ctime": %s, "cmbs": %s, "crss": %d, ' \
+			${c[0]} $cmbs ${c[1]} >> $json
+		printf '"dtime": %s, "dmbs": %s, "drss": %d, "ok": %s}' \
+			${d[0]} $dmbs ${d[1]} $ok >> $json
+		sep=$',\n'
+	done
+done
+
+echo $'\n]' >> $json
+rm -f $tmp.z $tmp.o
+
+echo "Results in $csv and $json"
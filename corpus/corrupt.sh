@@ -0,0 +1,33 @@
+#!/bin/bash
+# Corrupt input must be rejected with an error, not hang or crash.
+
+zz=${1:-../wee}
+tmp=corrupt.$$
+
+# name and hex of each stream
+cases=(
+	zero-offset	07e101002dd04427	# history slot 0 before any offset
+)
+
+err=0
+for ((i = 0; i < ${#cases[*]}; i += 2))
+do
+	printf "$(echo ${cases[i + 1]} | sed 's/../\\x&/g')" > $tmp.wee
+	for how in file stdin
+	do
+		if [ $how = file ]
+		then timeout 10 $zz -d -c $tmp.wee > /dev/null 2>&1
+		else timeout 10 $zz -d -c < $tmp.wee > /dev/null 2>&1
+		fi
+		rc=$?
+		if [ $rc -eq 0 -o $rc -ge 124 ]
+		then
+			echo $zz "!!! CORRUPT INPUT ERROR WITH" ${cases[i]} \
+				"($how, exit $rc) !!!"
+			err=1
+		fi
+	done
+done
+rm -f $tmp.wee
+
+exit $err
@@ -0,0 +1,333 @@
+// wbench.c
+// Benchmark helper: synthetic corpus generator and a command timer.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+const char wbench_usage[] =
+    "Usage: wbench gen DIR [MB]        Write synthetic test files to DIR.\n"
+    "       wbench run IN OUT CMD...   Run CMD <IN >OUT; print wall time\n"
+    "                                  in seconds and peak RSS in KiB.\n";
+
+// xorshift64* generator; fixed seeds make the corpus reproducible
+
+static uint64_t wb_s;
+
+static inline uint64_t wb_rand(void)
+{
+    wb_s ^= wb_s >> 12;
+    wb_s ^= wb_s << 25;
+    wb_s ^= wb_s >> 27;
+
+    return wb_s * 0x2545F4914F6CDD1DULL;
+}
+
+// uniform in 0..n-1 (n small)
+
+static inline uint32_t wb_rn(uint32_t n)
+{
+    return (uint32_t) ((wb_rand() >> 32) * n >> 32);
+}
+
+// skewed towards small values, roughly Zipf-like
+
+static inline uint32_t wb_zipf(uint32_t n)
+{
+    return (uint64_t) wb_rn(n) * wb_rn(n) / n;
+}
+
+// Output buffer for one file; flushed when full.
+
+typedef struct {
+    FILE        *f;
+    uint64_t    len, lim;               // written, target size
+    size_t      ptr;
+    uint8_t     buf[1 << 16];
+} wb_out_t;
+
+static void wb_put(wb_out_t *o, const void *p, size_t n)
+{
+    if (o->len + n > o->lim)            // truncate at the exact size
+        n = o->lim - o->len;
+    if (o->ptr + n > sizeof(o->buf)) {
+        if (fwrite(o->buf, 1, o->ptr, o->f) != o->ptr) {
+            perror("fwrite()");
+            exit(1);
+        }
+        o->ptr = 0;
+    }
+    if (n > sizeof(o->buf)) {
+        if (fwrite(p, 1, n, o->f) != n) {
+            perror("fwrite()");
+            exit(1);
+        }
+    } else {
+        memcpy(&o->buf[o->ptr], p, n);
+        o->ptr += n;
+    }
+    o->len += n;
+}
+
+static int wb_full(const wb_out_t *o)
+{
+    return o->len >= o->lim;
+}
+
+// Vocabulary of pronounceable words for text and logs.
+
+#define WB_NWORD 8192
+
+static char wb_word[WB_NWORD][16];
+
+static void wb_vocab(void)
+{
+    static const char *con = "bcdfghklmnprstvwyz", *vow = "aeiou";
+    int i, j, n;
+    char *w;
+
+    wb_s = 0x7E47;
+    for (i = 0; i < WB_NWORD; i++) {
+        w = wb_word[i];
+        n = 1 + wb_rn(4);               // syllables
+        for (j = 0; j < n; j++) {
+            *w++ = con[wb_rn(18)];
+            *w++ = vow[wb_rn(5)];
+            if (wb_rn(3) == 0)
+                *w++ = con[wb_rn(18)];
+        }
+        *w = 0;
+    }
+}
+
+// English-looking text: sentences of skewed words wrapped at 72 columns.
+
+static void wb_text(wb_out_t *o)
+{
+    char line[128], *w;
+    int col, n, cap;
+
+    wb_s = 0x1E57;
+    col = 0;
+    cap = 1;
+    while (!wb_full(o)) {
+        w = wb_word[wb_zipf(WB_NWORD)];
+        n = snprintf(line, sizeof(line), "%s%s", col > 0 ? " " : "", w);
+        if (cap)
+            line[col > 0] &= ~0x20;     // capitalize
+        cap = 0;
+        if (wb_rn(12) == 0) {           // end of sentence
+            line[n++] = wb_rn(8) == 0 ? '?' : '.';
+            cap = 1;
+        } else if (wb_rn(10) == 0) {
+            line[n++] = ',';
+        }
+        if (col + n > 72) {
+            if (cap && wb_rn(6) == 0)   // paragraph break
+                wb_put(o, "\n", 1);
+            wb_put(o, "\n", 1);
+            if (line[0] == ' ')
+                memmove(line, line + 1, n--);
+            col = 0;
+        }
+        wb_put(o, line, n);
+        col += n;
+    }
+}
+
+// Web server style log lines with a steadily advancing clock.
+
+static void wb_log(wb_out_t *o)
+{
+    static const char *lvl[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN",
+        "ERROR" };
+    static const char *mth[] = { "GET", "GET", "GET", "POST", "PUT",
+        "DELETE" };
+    static const int sts[] = { 200, 200, 200, 200, 201, 304, 404, 500 };
+    char line[256];
+    uint64_t t;
+    int n;
+
+    wb_s = 0x1067;
+    t = 1767225600000ULL;               // 2026-01-01 in milliseconds
+    while (!wb_full(o)) {
+        t += wb_rn(40);
+        n = snprintf(line, sizeof(line),
+            "%llu.%03u host%02u app[%u]: %s %s /api/v1/%s/%u %d %ums "
+            "user=%s%u\n",
+            (unsigned long long) (t / 1000), (unsigned) (t % 1000),
+            wb_rn(16), 1000 + wb_rn(8), lvl[wb_rn(6)], mth[wb_rn(6)],
+            wb_word[wb_zipf(64)], wb_zipf(100000), sts[wb_rn(8)],
+            wb_zipf(2000), wb_word[wb_zipf(WB_NWORD)], wb_rn(100));
+        wb_put(o, line, n);
+    }
+}
+
+// Fixed 32-byte binary records of slowly varying telemetry.
+
+static void wb_table(wb_out_t *o)
+{
+    uint8_t r[32];
+    uint32_t id, t, cnt;
+    uint16_t sen, st;
+    float val[2];
+
+    wb_s = 0x7AB1;
+    id = 0;
+    t = 1767225600;
+    cnt = 0;
+    val[0] = 20.0;
+    val[1] = 1000.0;
+    while (!wb_full(o)) {
+        memset(r, 0, sizeof(r));
+        id++;
+        t += wb_rn(4);
+        sen = wb_zipf(256);
+        st = wb_rn(64) == 0 ? wb_rn(8) : 0;
+        val[0] += ((int) wb_rn(21) - 10) * 0.01f;
+        val[1] += ((int) wb_rn(3) - 1) * 0.5f;
+        cnt += wb_rn(3);
+        memcpy(&r[0], &id, 4);          // host byte order
+        memcpy(&r[4], &t, 4);
+        memcpy(&r[8], &sen, 2);
+        memcpy(&r[10], &st, 2);
+        memcpy(&r[12], val, 8);
+        memcpy(&r[20], &cnt, 4);
+        wb_put(o, r, sizeof(r));
+    }
+}
+
+// Incompressible noise.
+
+static void wb_random(wb_out_t *o)
+{
+    uint64_t x[512];
+    int i;
+
+    wb_s = 0x4A2D;
+    while (!wb_full(o)) {
+        for (i = 0; i < 512; i++)
+            x[i] = wb_rand();
+        wb_put(o, x, sizeof(x));
+    }
+}
+
+// Random blocks repeated with a few mutations; periods both inside and
+// well beyond the 1 MB encoder window.
+
+static void wb_repeat(wb_out_t *o)
+{
+    static const uint32_t per[] = { 100000, 1500000, 6000000 };
+    uint8_t *b;
+    uint32_t p, i, k;
+    uint64_t seg;
+
+    wb_s = 0x3E9E;
+    if ((b = malloc(per[2])) == NULL) {
+        perror("malloc()");
+        exit(1);
+    }
+    for (k = 0; !wb_full(o); k++) {
+        p = per[k % 3];
+        for (i = 0; i < p; i++)
+            b[i] = wb_rand();
+        for (seg = 0; seg < 16 * p && !wb_full(o); seg += p) {
+            for (i = 0; i < p / 10000; i++)
+                b[wb_rn(p)] = wb_rand();
+            wb_put(o, b, p);
+        }
+    }
+    free(b);
+}
+
+// Write all synthetic files of "mb" megabytes each into directory dir.
+
+static int wb_gen(const char *dir, uint64_t mb)
+{
+    static const struct {
+        const char *name;
+        void (*fn)(wb_out_t *);
+    } gen[] = {
+        { "text", wb_text }, { "log", wb_log }, { "table", wb_table },
+        { "random", wb_random }, { "repeat", wb_repeat }
+    };
+    static wb_out_t o;
+    char fn[4096];
+    int i;
+
+    wb_vocab();
+    for (i = 0; i < sizeof(gen) / sizeof(gen[0]); i++) {
+        snprintf(fn, sizeof(fn), "%s/%s", dir, gen[i].name);
+        if ((o.f = fopen(fn, "wb")) == NULL) {
+            perror(fn);
+            return 1;
+        }
+        o.len = 0;
+        o.lim = mb << 20;
+        o.ptr = 0;
+        gen[i].fn(&o);
+        if (fwrite(o.buf, 1, o.ptr, o.f) != o.ptr || fclose(o.f) != 0) {
+            perror(fn);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Run a command with redirected input and output; report wall time and
+// the peak resident set size of the child.
+
+static int wb_run(const char *in, const char *out, char **cmd)
+{
+    struct timespec t0, t1;
+    struct rusage ru;
+    int st, fd;
+    pid_t pid;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if ((pid = fork()) < 0) {
+        perror("fork()");
+        return 1;
+    }
+    if (pid == 0) {
+        if ((fd = open(in, O_RDONLY)) < 0 || dup2(fd, 0) < 0 ||
+            (fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0 ||
+            dup2(fd, 1) < 0) {
+            perror("open()");
+            _exit(127);
+        }
+        execvp(cmd[0], cmd);
+        perror(cmd[0]);
+        _exit(127);
+    }
+    if (wait4(pid, &st, 0, &ru) < 0) {
+        perror("wait4()");
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    printf("%.3f %ld\n", (t1.tv_sec - t0.tv_sec) +
+        1E-9 * (t1.tv_nsec - t0.tv_nsec), ru.ru_maxrss);
+
+    return !WIFEXITED(st) || WEXITSTATUS(st) != 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 3 && strcmp(argv[1], "gen") == 0)
+        return wb_gen(argv[2], argc > 3 ? strtoull(argv[3], NULL, 0) : 256);
+    if (argc >= 5 && strcmp(argv[1], "run") == 0)
+        return wb_run(argv[2], argv[3], &argv[4]);
+
+    fprintf(stderr, "%s", wbench_usage);
+
+    return 1;
+}
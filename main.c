@@ -4,83 +4,489 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <libgen.h>
 #include <utime.h>
+#include <dirent.h>
+#include <fcntl.h>
 
-#include "wee.h"
+#include "weei.h"
 
 const char wee_usage[] =
     "Usage: wee [OPTION]... [FILE]...\n"
     "Compress or uncompress FILEs. OPTIONs:\n"
     "\n"
+    "  -1 .. -9 Compress faster .. better (default -6).\n"
+    "  -a A Compress FILEs into one solid archive A.\n"
+    "  -b   Benchmark FILEs in memory; round trips with the options below.\n"
+    "  -B L Benchmark block sizes in list L, e.g. 64K,1M (default: file).\n"
     "  -c   Write on standard output, keep original files unchanged.\n"
+    "  -D L Benchmark match search depths in list L.\n"
     "  -d   Decompress rather than compress files.\n"
+    "  -e A Extract FILEs (default: all) from solid archive A.\n"
     "  -h   Give this help.\n"
+    "  -i N Benchmark best of N round trips (default 3).\n"
+    "  -j N Process up to N files at a time.\n"
     "  -k   Keep (don't delete) input files.\n"
+    "  -l   List the contents of solid archives FILEs.\n"
+    "  -N L Benchmark nice match lengths in list L.\n"
+    "  -r   Operate recursively on directories.\n"
+    "  -T N Use N threads; compress in independent frames.\n"
     "  -v   Verbose output.\n"
+    "  -x O[,L] Extract L bytes (default: the rest) at offset O of framed\n"
+    "       FILEs; implies -c.\n"
     "\n"
     "wee v0.1 by Markku-Juhani O. Saarinen <mjos@iki.fi>  Feedback welcome.\n";
 
-// command line parameters
+// Option argument: the rest of this word, or else the next one. Set *val
+// to it and return the number of following words used up (0 or 1).
 
-int main(int argc, char **argv)
+static int wee_optarg(int argc, char **argv, int i, int *j, char **val)
 {
-    int i, j, fl, er;
-    int dec, keep, verb, stdo;
-    char fn[4096], *s;
+    char *s;
+
+    s = &argv[i][*j + 1];
+    *j += strlen(s);                    // no more options in this word
+    if (*s == 0 && i + 1 < argc) {
+        *val = argv[i + 1];
+        return 1;
+    }
+    *val = s;
+
+    return 0;
+}
+
+#define WEE_WBUF 0x40000                // output file buffer
+#define WEE_AHEAD 8                     // files read ahead one at a time
+#define WEE_RALEN 0x1000000             // .. up to this much of each
+
+// Number in an -x range: digits first (no sign or blanks), and it must
+// fit. Return nonzero if it isn't one; *t is set past it.
+
+static int wee_xnum(const char *s, char **t, uint64_t *x)
+{
+    if (*s < '0' || *s > '9')
+        return -1;
+    errno = 0;
+    *x = strtoull(s, t, 0);
+
+    return errno != 0;
+}
+
+// Options that apply to every file.
+
+typedef struct {
+    int         dec, keep, verb, stdo;  // flags
+    int         nthr, lvl;              // threads per file, level
+    int         ext;                    // extract a range
+    int         arc;                    // solid archive: 'a', 'e' or 'l'
+    uint64_t    xof, xln;               // .. at this offset and length
+} wee_cli_t;
+
+// A file to process; runs as a worker pool job with -j.
+
+typedef struct {
+    wee_job_t   job;                    // worker pool job
+    const wee_cli_t *cli;               // options
+    const char  *prg, *name;            // program and input file name
+    char        fn[4096];               // output file name
+    size_t      isz, osz;               // sizes for the -v line
+    int         par;                    // caller prints the -v line
+    int         run;                    // .. if the file got that far
+    int         er;                     // number of errors
+} wee_file_t;
+
+// Compress, decompress or extract file f->name.
+
+static void wee_file(void *arg)
+{
+    wee_file_t *f = arg;
+    const wee_cli_t *o = f->cli;
     FILE *fin, *fout;
     struct stat st;
     struct utimbuf ut;
+    size_t j, r;
+    int er, verb;
+
+    f->er = 0;
+    f->run = 0;
+    verb = o->verb && !f->par;          // library prints sizes
+
+    // compose output file name
+    j = strlen(f->name);
+    if (j > sizeof(f->fn) - 5) {
+        fprintf(stderr, "%s: filename too large -- ignored\n", f->prg);
+        f->er++;
+        return;
+    }
+
+    if (stat(f->name, &st)) {           // stat it
+        fprintf(stderr, "%s: ", f->prg);
+        perror(f->name);
+        f->er++;
+        return;
+    }
+
+    if (S_ISDIR(st.st_mode)) {          // check that not directory
+        fprintf(stderr, "%s: %s is a directory -- ignored\n",
+            f->prg, f->name);
+        f->er++;
+        return;
+    }
+
+    if ((fin = fopen(f->name, "rb")) == NULL) {
+        fprintf(stderr, "%s: ", f->prg);
+        perror(f->name);
+        f->er++;
+        return;
+    }
+
+    if (o->stdo) {                      // -c flag invoked; standard output
+        snprintf(f->fn, sizeof(f->fn), "standard output");
+        fout = stdout;
+
+    } else {                            // normal file naming
+        if (o->dec) {
+            if (j > 4 && strcmp(&f->name[j - 4], ".wee") == 0) {
+                memcpy(f->fn, f->name, j - 4);
+                f->fn[j - 4] = 0;
+            } else {
+                fprintf(stderr, "%s: %s: Unknown suffix -- ignored.\n",
+                    f->prg, f->name);
+                fclose(fin);
+                f->er++;
+                return;
+            }
+        } else {
+            snprintf(f->fn, sizeof(f->fn), "%s.wee", f->name);
+        }
+
+        if ((fout = fopen(f->fn, "wb")) == NULL) {
+            fprintf(stderr, "%s: ", f->prg);
+            perror(f->fn);
+            fclose(fin);
+            f->er++;
+            return;
+        }
+        // the coders write 4 kB at a time; batch that into fewer writes
+        setvbuf(fout, NULL, _IOFBF, WEE_WBUF);
+    }
+
+    if (o->ext) {                       // transform files
+        er = wee_file_ext(fin, fout, o->xof, o->xln, verb) != 0;
+        r = 0;
+    } else if (o->dec) {
+        r = wee_file_dec_mt(fin, fout, o->nthr, verb);
+        er = r == WEE_ERROR;
+    } else {
+        r = o->nthr > 0 ? wee_file_enc_mt(fin, fout, o->nthr, o->lvl, verb) :
+            wee_file_enc(fin, fout, o->lvl, verb);
+        er = r == WEE_ERROR;
+    }
+    f->er += er;
+    f->isz = st.st_size;
+    f->osz = r;
+    f->run = 1;
+    if (verb && er)
+        printf("(error)");
+    if (verb)                           // add file name to verbose output
+        printf("%s\n", f->fn);
+
+    fclose(fin);                        // close files
+    if (!o->stdo) {
+        if (fclose(fout) && !er) {      // last batch written here
+            fprintf(stderr, "%s: ", f->prg);
+            perror(f->fn);
+            f->er++;
+            er = 1;
+        }
+
+        // attempt to change modes and time to match with original
+        chmod(f->fn, st.st_mode & 07777);
+        ut.actime = st.st_atime;
+        ut.modtime = st.st_mtime;
+        utime(f->fn, &ut);
+    }
+
+    if (!o->keep && er == 0) {          // unless keep is set
+        if (remove(f->name)) {
+            fprintf(stderr, "%s: ", f->prg);
+            perror(f->name);
+            f->er++;
+        }
+    }
+}
+
+// Print the -v line of a file processed by a worker, as wee_file() would.
+
+static void wee_file_verb(const wee_file_t *f)
+{
+    double isz = f->isz, osz = f->osz;
+
+    if (!f->run)                        // failed before coding
+        return;
+    if (f->osz == WEE_ERROR) {
+        printf("(error)");
+    } else {
+        printf("%12zu %12zu  %.1f%%  ", f->isz, f->osz,
+            f->cli->dec ? 100.0 * (osz - isz) / osz :
+            100.0 * (isz - osz) / isz);
+    }
+    printf("%s\n", f->fn);
+}
+
+// File names to process: the command line, with directories expanded.
+
+typedef struct {
+    char        **v;                    // names
+    size_t      n, max;                 // .. number and allocated
+} wee_names_t;
+
+// Append name s to l; l takes ownership of s.
+
+static void wee_names_add(wee_names_t *l, char *s)
+{
+    if (l->n >= l->max) {
+        l->max = l->max > 0 ? 2 * l->max : 0x100;
+        if ((l->v = realloc(l->v, l->max * sizeof(char *))) == NULL) {
+            perror("realloc()");
+            exit(1);
+        }
+    }
+    l->v[l->n++] = s;
+}
+
+// Add the regular files in the tree under "dir" to l: those ending in
+// .wee to decompress, the others to compress, all of them for an archive.
+// Symbolic links and special files are skipped. Return the number of errors.
+
+static int wee_walk(wee_names_t *l, const char *dir, const wee_cli_t *o,
+    const char *prg)
+{
+    DIR *d;
+    struct dirent *de;
+    struct stat st;
+    size_t n, k;
+    char *p;
+    int er;
+
+    if ((d = opendir(dir)) == NULL) {
+        fprintf(stderr, "%s: ", prg);
+        perror(dir);
+        return 1;
+    }
+
+    er = 0;
+    k = strlen(dir);
+    while (k > 1 && dir[k - 1] == '/')  // no "dir//name"
+        k--;
+    while ((de = readdir(d)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+            continue;
+        n = strlen(de->d_name);
+        if ((p = malloc(k + n + 2)) == NULL) {
+            perror("malloc()");
+            exit(1);
+        }
+        memcpy(p, dir, k);
+        p[k] = '/';
+        memcpy(&p[k + 1], de->d_name, n + 1);
+
+        if (lstat(p, &st)) {
+            fprintf(stderr, "%s: ", prg);
+            perror(p);
+            er++;
+        } else if (S_ISDIR(st.st_mode)) {
+            er += wee_walk(l, p, o, prg);
+        } else if (S_ISREG(st.st_mode) && (o->arc == 'a' || o->dec ==
+            (n > 4 && strcmp(&de->d_name[n - 4], ".wee") == 0))) {
+            wee_names_add(l, p);
+            continue;
+        }
+        free(p);
+    }
+    closedir(d);
 
-    dec = 0;
-    keep = 0;
-    verb = 0;
-    stdo = 0;
+    return er;
+}
+
+// Ask the kernel to start reading the head of a queued file, so that it
+// is in the page cache when its turn comes; many reads are then in flight
+// at a time.
+
+static void wee_prefetch(const char *name)
+{
+#ifdef POSIX_FADV_WILLNEED
+    int fd;
+
+    if ((fd = open(name, O_RDONLY)) >= 0) {
+        posix_fadvise(fd, 0, WEE_RALEN, POSIX_FADV_WILLNEED);
+        close(fd);
+    }
+#endif
+}
+
+// command line parameters
+
+int main(int argc, char **argv)
+{
+    int i, j, nx, fl, nfn, bench, iter, njob, rec;
+    char *s, *t, *blks, *deps, *nics, **fn, *arc;
+    wee_cli_t o;
+    wee_file_t f, *fj;
+    wee_pool_t pool;
+    wee_names_t nm;
+    struct stat st;
+    size_t k, nfj, rd, wr;
+
+    o.dec = 0;
+    o.keep = 0;
+    o.verb = 0;
+    o.stdo = 0;
+    o.nthr = 0;
+    o.ext = 0;
+    o.arc = 0;
+    o.xof = 0;
+    o.xln = 0;
+    o.lvl = WEE_LEVEL;
+    bench = 0;
+    iter = 3;
+    njob = 1;
+    rec = 0;
+    blks = NULL;
+    deps = NULL;
+    nics = NULL;
+    arc = NULL;
 
     if (argc > 0) {                     // alternative command names
         s = basename(argv[0]);
         if (strcmp(s, "unwee") == 0)
-            dec = 1;
+            o.dec = 1;
         if (strcmp(s, "weecat") == 0) {
-            dec = 1;
-            stdo = 1;
+            o.dec = 1;
+            o.stdo = 1;
         }
     }
 
     // get parameters
-    fl = 0;                             // here used to count actual filenames
+    if ((fn = calloc(argc + 1, sizeof(char *))) == NULL) {
+        perror("calloc()");
+        return 1;
+    }
+    nfn = 0;                            // actual filenames
     for (i = 1; i < argc; i++) {
         if (argv[i][0] == '-' &&
             !(i > 1 && strcmp(argv[i - 1], "--") == 0)) {
 
-            // command line argument
+            // command line argument; nx words of option values follow
+            nx = 0;
             for (j = 1; argv[i][j] != 0; j++) {
                 switch(argv[i][j]) {
 
+                    case '1': case '2': case '3':
+                    case '4': case '5': case '6':
+                    case '7': case '8': case '9':
+                        o.lvl = argv[i][j] - '0';
+                        break;
+
+                    case 'a':           // solid archive
+                    case 'e':
+                        o.arc = argv[i][j];
+                        nx = wee_optarg(argc, argv, i, &j, &arc);
+                        break;
+
+                    case 'l':
+                        o.arc = 'l';
+                        break;
+
+                    case 'b':           // benchmark
+                        bench = 1;
+                        break;
+
+                    case 'B':           // benchmark parameter lists
+                        nx = wee_optarg(argc, argv, i, &j, &blks);
+                        break;
+
+                    case 'D':
+                        nx = wee_optarg(argc, argv, i, &j, &deps);
+                        break;
+
+                    case 'N':
+                        nx = wee_optarg(argc, argv, i, &j, &nics);
+                        break;
+
+                    case 'i':           // benchmark iterations
+                        nx = wee_optarg(argc, argv, i, &j, &s);
+                        if ((iter = atoi(s)) < 1) {
+                            fprintf(stderr,
+                                "%s: invalid iteration count -- '%s'\n",
+                                argv[0], s);
+                            return 1;
+                        }
+                        break;
+
                     case 'c':           // write to stdout
-                        stdo = 1;
-                        keep = 1;
+                        o.stdo = 1;
+                        o.keep = 1;
                         break;
 
                     case 'd':           // decompress flag
-                        dec = 1;
+                        o.dec = 1;
                         break;
 
                     case 'h':           // version, exit
                         printf("%s", wee_usage);
                         return 0;
 
+                    case 'j':           // files in parallel; -j4 or -j 4
+                        nx = wee_optarg(argc, argv, i, &j, &s);
+                        if ((njob = atoi(s)) < 1) {
+                            fprintf(stderr,
+                                "%s: invalid job count -- '%s'\n",
+                                argv[0], s);
+                            return 1;
+                        }
+                        break;
+
                     case 'k':           // keep original files
-                        keep = 1;
+                        o.keep = 1;
+                        break;
+
+                    case 'r':           // recurse into directories
+                        rec = 1;
                         break;
 
                     case 'v':           // verbose
-                        verb = 1;
+                        o.verb = 1;
                         break;
 
+                    case 'T':           // threads; -T4 or -T 4
+                        nx = wee_optarg(argc, argv, i, &j, &s);
+                        if ((o.nthr = atoi(s)) < 1) {
+                            fprintf(stderr,
+                                "%s: invalid thread count -- '%s'\n",
+                                argv[0], s);
+                            return 1;
+                        }
+                        break;
+
+                    case 'x':           // extract a range
+                        nx = wee_optarg(argc, argv, i, &j, &s);
+                        o.xln = UINT64_MAX;     // to the end
+                        if (wee_xnum(s, &t, &o.xof) || (*t == ',' &&
+                            wee_xnum(t + 1, &t, &o.xln)) || *t != 0) {
+                            fprintf(stderr,
+                                "%s: invalid range -- '%s'\n", argv[0], s);
+                            return 1;
+                        }
+                        o.ext = 1;
+                        o.dec = 1;
+                        o.stdo = 1;
+                        o.keep = 1;
+                        break;
 
                     case '-':           // either an escape or failure
                         if (j == 1 && argv[i][2] == 0)
@@ -92,115 +498,107 @@ int main(int argc, char **argv)
                         return 1;
                 }
             }
+            i += nx;                    // skip the option value
         } else {
-            fl++;
+            fn[nfn++] = argv[i];
         }
     }
 
+    // benchmark named files in memory
+    if (bench) {
+        fl = wee_bench(fn, nfn, o.lvl, iter, blks, deps, nics);
+        free(fn);
+        return fl;
+    }
+
     // no files (or plain "-") -- dump stdin to stdout
-    if (fl == 0) {
-        if (dec) {
-            return wee_file_dec(stdin, stdout, 0) != 0;
+    if (nfn == 0 && o.arc == 'l')
+        return wee_arc_list("-", o.verb) != 0;
+    if (nfn == 0 && o.arc == 0) {
+        if (o.ext) {
+            return wee_file_ext(stdin, stdout, o.xof, o.xln, 0) != 0;
+        } else if (o.dec) {
+            return wee_file_dec_mt(stdin, stdout, o.nthr, 0) == WEE_ERROR;
+        } else if (o.nthr > 0) {
+            return wee_file_enc_mt(stdin, stdout, o.nthr, o.lvl, 0) ==
+                WEE_ERROR;
         } else {
-            return wee_file_enc(stdin, stdout, 0) != 0;
+            return wee_file_enc(stdin, stdout, o.lvl, 0) == WEE_ERROR;
         }
     }
 
-    // now handle files
+    // list the files, walking directories with -r
     fl = 0;                             // used here to count errors
-    for (i = 1; i < argc; i++) {
-        if (argv[i][0] != '-' || (i > 1 && strcmp(argv[i - 1], "--") == 0)) {
-
-            // compose output file name
-            j = strlen(argv[i]);
-            if (j > sizeof(fn) - 5) {
-                fprintf(stderr,
-                    "%s: filename too large -- ignored\n", argv[0]);
-                fl++;
-                continue;
-            }
-
-            if (stat(argv[i], &st)) {   // stat it
-                fprintf(stderr, "%s: ", argv[0]);
-                perror(argv[i]);
-                fl++;
-                continue;
-            }
-
-            if (S_ISDIR(st.st_mode)) {  // check that not directory
-                fprintf(stderr, "%s: %s is a directory -- ignored\n",
-                    argv[0], argv[i]);
-                fl++;
-                continue;
-            }
-
-            if ((fin = fopen(argv[i], "rb")) == NULL) {
-                fprintf(stderr, "%s: ", argv[0]);
-                perror(argv[i]);
-                fl++;
-                continue;
-            }
-
-            if (stdo) {                 // -c flag invoked; standard output
-                snprintf(fn, sizeof(fn), "standard output");
-                fout = stdout;
-
-            } else {                    // normal file naming
-                if (dec) {
-                    if (j > 4 || strcmp(&argv[i][j - 4], ".wee") == 0) {
-                        memcpy(fn, argv[i], j - 4);
-                        fn[j - 4] = 0;
-                    } else {
-                        fprintf(stderr, "%s: %s: Unknown suffix -- ignored.\n",
-                            argv[0], argv[i]);
-                        fl++;
-                        continue;
-                    }
-                } else {
-                    snprintf(fn, sizeof(fn), "%s.wee", argv[i]);
-                }
-
-                if ((fout = fopen(fn, "wb")) == NULL) {
-                    fprintf(stderr, "%s: ", argv[0]);
-                    perror(fn);
-                    fclose(fin);
-                    fl++;
-                    continue;
-                }
-            }
+    memset(&nm, 0, sizeof(nm));
+    for (i = 0; i < nfn; i++) {
+        if (rec && o.arc != 'e' && stat(fn[i], &st) == 0 &&
+            S_ISDIR(st.st_mode)) {
+            fl += wee_walk(&nm, fn[i], &o, argv[0]);
+        } else if ((s = strdup(fn[i])) == NULL) {
+            perror("strdup()");
+            return 1;
+        } else {
+            wee_names_add(&nm, s);
+        }
+    }
+    free(fn);
 
-            if (dec) {                  // transform files
-                er = wee_file_dec(fin, fout, verb) == 0;
-            } else {
-                er = wee_file_enc(fin, fout, verb) == 0;
-            }
-            fl += er;
-            if (verb && er)
-                printf("(error)");
-            if (verb)                   // add file name to verbose output
-                printf("%s\n", fn);
-
-            fclose(fin);                // close files
-            if (!stdo) {
-                fclose(fout);
-
-                // attempt to change modes and time to match with original
-                chmod(fn, st.st_mode & 07777);
-                ut.actime = st.st_atime;
-                ut.modtime = st.st_mtime;
-                utime(fn, &ut);
-            }
+    // now handle files
+    f.cli = &o;
+    f.prg = argv[0];
+    f.par = 0;
+    if (o.arc == 'a') {                 // solid archive; FILEs are members
+        fl += wee_arc_create(arc, nm.v, nm.n, o.lvl, o.verb);
+    } else if (o.arc == 'e') {
+        fl += wee_arc_ext(arc, nm.v, nm.n, o.stdo, o.verb);
+    } else if (o.arc == 'l') {
+        for (k = 0; k < nm.n; k++)
+            fl += wee_arc_list(nm.v[k], o.verb) != 0;
+    } else if (njob <= 1 || o.stdo) {   // one at a time
+        for (k = 0, rd = 0; k < nm.n; k++) {
+            while (rd < nm.n && rd < k + WEE_AHEAD)
+                wee_prefetch(nm.v[rd++]);
+            f.name = nm.v[k];
+            wee_file(&f);
+            fl += f.er;
+        }
 
-            if (!keep && er == 0) {     // unless keep is set
-                if (remove(argv[i])) {
-                    fprintf(stderr, "%s: ", argv[0]);
-                    perror(argv[i]);
-                    fl++;
-                }
+    } else {                            // a pool of workers
+        nfj = 4 * njob;                 // jobs queued or running
+        if ((fj = calloc(nfj, sizeof(wee_file_t))) == NULL) {
+            perror("calloc()");
+            return 1;
+        }
+        if (wee_pool_init(&pool, njob)) {
+            fprintf(stderr, "Can't start threads.\n");
+            return 1;
+        }
+        rd = 0;
+        wr = 0;
+        while (wr < nm.n) {
+            while (rd < nm.n && rd - wr < nfj) {
+                wee_prefetch(nm.v[rd]);
+                fj[rd % nfj] = f;
+                fj[rd % nfj].name = nm.v[rd];
+                fj[rd % nfj].par = 1;
+                wee_pool_put(&pool, &fj[rd % nfj].job, wee_file,
+                    &fj[rd % nfj]);
+                rd++;
             }
+            // -v lines are printed in order by this thread
+            wee_pool_wait(&pool, &fj[wr % nfj].job);
+            if (o.verb)
+                wee_file_verb(&fj[wr % nfj]);
+            fl += fj[wr % nfj].er;
+            wr++;
         }
+        wee_pool_free(&pool);
+        free(fj);
     }
 
+    for (k = 0; k < nm.n; k++)
+        free(nm.v[k]);
+    free(nm.v);
+
     return fl;
 }
-
@@ -0,0 +1,168 @@
+// sais.c
+// Linear-time suffix array construction via induced sorting (SA-IS).
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "weei.h"
+
+// Nong, Zhang, Chan: "Two Efficient Algorithms for Linear Time Suffix
+// Array Construction", IEEE Trans. Computers 60(10), 2011. A virtual
+// sentinel smaller than any symbol is assumed past the end of the string,
+// so arbitrary binary data can be sorted as-is.
+
+// character i of either a byte (level 0) or integer (recursion) string
+
+#define SAIS_CHR(i) (cs == 1 ? ((const uint8_t *) s)[i] : \
+    ((const int32_t *) s)[i])
+
+// suffix types; nonzero means S-type
+
+#define SAIS_TGET(i) (t[i])
+#define SAIS_LMS(i) ((i) > 0 && t[i] && !t[(i) - 1])
+
+// Compute bucket heads (end = 0) or ends (end = 1) from symbol counts.
+
+static void sais_bkt(const int32_t *cnt, int32_t *bkt, int32_t k, int end)
+{
+    int32_t i, sum;
+
+    for (i = 0, sum = 0; i < k; i++) {
+        sum += cnt[i];
+        bkt[i] = end ? sum : sum - cnt[i];
+    }
+}
+
+// Induce L-type and then S-type suffixes from sorted LMS suffixes.
+
+static void sais_induce(const void *s, int cs, const uint8_t *t,
+    int32_t *sa, int32_t n, const int32_t *cnt, int32_t *bkt, int32_t k)
+{
+    int32_t i, j;
+
+    sais_bkt(cnt, bkt, k, 0);           // L-type, left to right
+    j = n - 1;                          // preceded by the virtual sentinel
+    sa[bkt[SAIS_CHR(j)]++] = j;
+    for (i = 0; i < n; i++) {
+        j = sa[i] - 1;
+        if (j >= 0 && !SAIS_TGET(j))
+            sa[bkt[SAIS_CHR(j)]++] = j;
+    }
+
+    sais_bkt(cnt, bkt, k, 1);           // S-type, right to left
+    for (i = n - 1; i >= 0; i--) {
+        j = sa[i] - 1;
+        if (j >= 0 && SAIS_TGET(j))
+            sa[--bkt[SAIS_CHR(j)]] = j;
+    }
+}
+
+// Recursive core; s has n symbols of size cs from alphabet 0..k-1.
+
+static void sais_main(const void *s, int cs, int32_t *sa, int32_t n,
+    int32_t k)
+{
+    uint8_t *t;
+    int32_t *cnt, *bkt, *s1, *sa1;
+    int32_t i, j, d, n1, name, pos, prev;
+
+    if (n == 1) {
+        sa[0] = 0;
+        return;
+    }
+
+    if ((t = calloc(n, 1)) == NULL ||
+        (cnt = calloc(2 * k, sizeof(int32_t))) == NULL) {
+        perror("sais calloc()");
+        exit(1);
+    }
+    bkt = cnt + k;
+
+    // classify; last symbol is L-type due to the sentinel
+    cnt[SAIS_CHR(n - 1)]++;
+    for (i = n - 2; i >= 0; i--) {
+        cnt[SAIS_CHR(i)]++;
+        t[i] = SAIS_CHR(i) < SAIS_CHR(i + 1) ||
+            (SAIS_CHR(i) == SAIS_CHR(i + 1) && t[i + 1]);
+    }
+
+    // stage 1: sort LMS substrings
+    sais_bkt(cnt, bkt, k, 1);
+    for (i = 0; i < n; i++)
+        sa[i] = -1;
+    for (i = 1; i < n; i++) {
+        if (SAIS_LMS(i))
+            sa[--bkt[SAIS_CHR(i)]] = i;
+    }
+    sais_induce(s, cs, t, sa, n, cnt, bkt, k);
+
+    // compact sorted LMS substrings into the first n1 items
+    for (i = 0, n1 = 0; i < n; i++) {
+        if (SAIS_LMS(sa[i]))
+            sa[n1++] = sa[i];
+    }
+
+    // name the substrings; LMS positions are never adjacent so the
+    // names fit in sa[n1 + pos / 2]
+    for (i = n1; i < n; i++)
+        sa[i] = -1;
+    name = 0;
+    prev = -1;
+    for (i = 0; i < n1; i++) {
+        pos = sa[i];
+        for (d = 0; ; d++) {
+            if (prev < 0 || pos + d == n || prev + d == n ||
+                SAIS_CHR(pos + d) != SAIS_CHR(prev + d) ||
+                SAIS_TGET(pos + d) != SAIS_TGET(prev + d)) {
+                name++;
+                prev = pos;
+                break;
+            }
+            if (d > 0 && (SAIS_LMS(pos + d) || SAIS_LMS(prev + d)))
+                break;
+        }
+        sa[n1 + (pos >> 1)] = name - 1;
+    }
+    for (i = n - 1, j = n - 1; i >= n1; i--) {
+        if (sa[i] >= 0)
+            sa[j--] = sa[i];
+    }
+
+    // stage 2: sort the reduced string, recursing if names not unique
+    s1 = sa + n - n1;
+    sa1 = sa;
+    if (name < n1) {
+        sais_main(s1, sizeof(int32_t), sa1, n1, name);
+    } else {
+        for (i = 0; i < n1; i++)
+            sa1[s1[i]] = i;
+    }
+
+    // stage 3: induce the full result from sorted LMS suffixes
+    sais_bkt(cnt, bkt, k, 1);
+    for (i = 1, j = 0; i < n; i++) {
+        if (SAIS_LMS(i))
+            s1[j++] = i;
+    }
+    for (i = 0; i < n1; i++)
+        sa1[i] = s1[sa1[i]];
+    for (i = n1; i < n; i++)
+        sa[i] = -1;
+    for (i = n1 - 1; i >= 0; i--) {
+        j = sa[i];
+        sa[i] = -1;
+        sa[--bkt[SAIS_CHR(j)]] = j;
+    }
+    sais_induce(s, cs, t, sa, n, cnt, bkt, k);
+
+    free(cnt);
+    free(t);
+}
+
+// Construct the suffix array of buf[0..n-1] into sa[0..n-1].
+
+void sais_sort(const uint8_t *buf, uint32_t *sa, uint32_t n)
+{
+    if (n > 0)
+        sais_main(buf, 1, (int32_t *) sa, n, 0x100);
+}
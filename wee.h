@@ -8,48 +8,97 @@
 #include <stdint.h>
 #include <stdio.h>
 
-// Range buffer structure
-typedef struct {
-    uint8_t *buf;                       // output buffer
-    size_t ptr, max;                    // pointer and maximum size (bytes)
-    int bit;                            // bit index
-    uint32_t byt;                       // partial byte
-    uint32_t b, l, v;                   // range indicators, optional input
-} aric_rb_t;
+// == weef.c ==
 
-// == aric.c ==
+// Error return value for the size_t functions.
+#define WEE_ERROR ((size_t) -1)
 
-// Initialize frequencies to "balanced".
-void aric_freqinit(uint32_t freq[][2], size_t bits);
+// Compression context; owns the window, dictionary search and models.
+typedef struct wee_ctx wee_ctx_t;
 
-// Divide frequencies in half, "de-emphasizing past".
-void aric_freqhalf(uint32_t freq[][2], size_t bits);
+// Allocate a reusable context. Return NULL on failure.
+wee_ctx_t *wee_ctx_new(void);
 
-// Update a frequency distribution for "bits"-sized word x.
-void aric_addfreq(uint32_t freq[][2], size_t bits, uint32_t x);
+// Free a context.
+void wee_ctx_free(wee_ctx_t *c);
 
-// Initialize a range buffer.
-void aric_init_rb(aric_rb_t *rb, void *buf, size_t len, int dec);
+// Default compression level (1 = fastest, 9 = best).
+#define WEE_LEVEL 6
 
-// Encode a "bits"-sized word to output stream.
-int aric_enc(aric_rb_t *rb,             // output range buffer
-    uint32_t iwrd,                      // input word to be encoded
-    uint32_t freq[][2], size_t bits);   // binary frequencies
+// Set compression level 1..9. Return nonzero if out of range.
+int wee_ctx_level(wee_ctx_t *c, int lvl);
 
-// Finalize output range buffer.
-size_t aric_final_out(aric_rb_t *rb);
+// Set match search depth and nice length (0 keeps the current value).
+// Return nonzero if out of range.
+int wee_ctx_tune(wee_ctx_t *c, uint32_t dep, uint32_t nic);
 
-// Decode input word.
-uint32_t aric_dec(aric_rb_t *rb,        // input range buffer
-    uint32_t freq[][2], size_t bits);   // binary frequencies
+// Limit the counts of the frequency count coder (-DWEE_PROB=0) to 2^lit
+// for literals and 2^sym for lengths and offsets, 0 for no limit; they
+// are recorded in the stream header. Return nonzero if out of range.
+int wee_ctx_flim(wee_ctx_t *c, int lit, int sym);
 
-// == weef.c ==
+// Compress src[len] to dst[cap] (same format as files). Return the
+// compressed size, or WEE_ERROR on failure or if it doesn't fit.
+size_t wee_compress(wee_ctx_t *c, void *dst, size_t cap,
+    const void *src, size_t len);
+
+// Decompress src[len] to dst[cap]; nothing past the decompressed data is
+// written. Return the decompressed size, or WEE_ERROR on failure or if it
+// doesn't fit.
+size_t wee_decompress(wee_ctx_t *c, void *dst, size_t cap,
+    const void *src, size_t len);
+
+// Flush modes for wee_enc_push()
+#define WEE_NOFLUSH 0
+#define WEE_SYNC 1                      // all input so far can be decoded
+#define WEE_FINISH 2                    // end the stream
+
+// Start a compressed stream on context c (format 07 E1). Return nonzero
+// on failure.
+int wee_enc_begin(wee_ctx_t *c);
+
+// Compress src[len] into the stream. Output collects in c until pulled.
+// Return nonzero on failure.
+int wee_enc_push(wee_ctx_t *c, const void *src, size_t len, int flush);
+
+// Get up to cap bytes of compressed output. Return number of bytes.
+size_t wee_enc_pull(wee_ctx_t *c, void *dst, size_t cap);
 
-// Compress fin to fout. Return output size or 0 in case of error.
-size_t wee_file_enc(FILE *fin, FILE *fout, int verb);
+// Start decoding a stream on context c. Return nonzero on failure.
+int wee_dec_begin(wee_ctx_t *c);
 
-// Decompress fin to fout. Return output size or 0 in case of error.
+// Feed compressed input. Return the number of bytes taken (less than len
+// if output must be pulled first) or WEE_ERROR.
+size_t wee_dec_push(wee_ctx_t *c, const void *src, size_t len);
+
+// Get up to cap bytes of decompressed output. Return number of bytes or
+// WEE_ERROR.
+size_t wee_dec_pull(wee_ctx_t *c, void *dst, size_t cap);
+
+// Return nonzero once the stream has ended and all output is pulled.
+int wee_dec_end(wee_ctx_t *c);
+
+// Compress fin to fout at level "lvl". Return output size or WEE_ERROR.
+size_t wee_file_enc(FILE *fin, FILE *fout, int lvl, int verb);
+
+// Compress fin to fout at level "lvl" in independent frames using "nthr"
+// threads. Return output size or WEE_ERROR.
+size_t wee_file_enc_mt(FILE *fin, FILE *fout, int nthr, int lvl,
+    int verb);
+
+// Decompress fin to fout. Return output size or WEE_ERROR.
 size_t wee_file_dec(FILE *fin, FILE *fout, int verb);
 
+// Decompress fin to fout, decoding frames in parallel with "nthr" threads.
+// Return output size or WEE_ERROR.
+size_t wee_file_dec_mt(FILE *fin, FILE *fout, int nthr, int verb);
+
+// Decompress "len" bytes from uncompressed offset "off" of a seekable
+// framed file, decoding only the frames that cover them; a range past
+// the end stops there (UINT64_MAX for all the rest). Return nonzero on
+// failure, or if "off" is beyond the end.
+int wee_file_ext(FILE *fin, FILE *fout, uint64_t off, uint64_t len,
+    int verb);
+
 #endif
 
@@ -0,0 +1,511 @@
+// weea.c
+// Solid archives: many files compressed as one stream.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <utime.h>
+
+#include "weei.h"
+
+// An archive is the magic "07 E3" followed by a single 07 E1 stream. The
+// stream holds a file table and then the contents of the files, back to
+// back in table order, so the models and the dictionary window carry over
+// from one file to the next; small files that look alike (configuration,
+// JSON, source) compress far better than on their own. The table is:
+//
+//   u32 number of files
+//   per file: u32 name length, name, u64 size, u32 mode, u64 mtime
+//
+// with little-endian integers. A file is reached by decoding everything
+// before it; listing decodes just the table.
+
+#define WEE_ABUF 0x40000                // file and stream buffers
+#define WEE_ANAM 4096                   // longest name
+
+// File table entry.
+
+typedef struct {
+    char        *name;                  // name, relative
+    uint64_t    size, mtime;            // size and modification time
+    uint32_t    mode;                   // permission bits
+} wee_aent_t;
+
+// Archive being read.
+
+typedef struct {
+    wee_ctx_t   *c;                     // decoder
+    FILE        *f;                     // archive
+    uint8_t     *buf;                   // compressed input
+    size_t      ptr, len;               // .. position and fill
+    wee_aent_t  *ent;                   // file table
+    uint32_t    n;                      // .. number of entries
+} wee_arc_t;
+
+// Little-endian integers in the file table.
+
+static void wee_arc_put(uint8_t *p, uint64_t x, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        p[i] = x >> (8 * i);
+}
+
+static uint64_t wee_arc_val(const uint8_t *p, int n)
+{
+    uint64_t x;
+    int i;
+
+    x = 0;
+    for (i = n - 1; i >= 0; i--)
+        x = (x << 8) | p[i];
+
+    return x;
+}
+
+// Pull all compressed output of c so far and write it to f. Return
+// nonzero on failure.
+
+static int wee_arc_drain(wee_ctx_t *c, FILE *f, uint8_t *buf, uint64_t *osz)
+{
+    size_t n;
+
+    while ((n = wee_enc_pull(c, buf, WEE_ABUF)) > 0) {
+        if (fwrite(buf, 1, n, f) != n) {
+            perror("fwrite()");
+            return -1;
+        }
+        *osz += n;
+    }
+
+    return 0;
+}
+
+// Compress files fn[nfn] into one solid archive "arc" ("-" for standard
+// output) at level "lvl". Return the number of errors.
+
+int wee_arc_create(const char *arc, char **fn, size_t nfn, int lvl,
+    int verb)
+{
+    wee_ctx_t *c;
+    FILE *fin, *fout;
+    struct stat st;
+    uint8_t *tab, *buf;
+    char *in;
+    size_t i, k, n, tln, tmx;
+    uint64_t isz, osz, rem;
+    uint32_t nf;
+    int er, ret;
+
+    // the table first; files that can't be archived are left out
+    er = 0;
+    nf = 0;
+    tmx = 0x1000;
+    if ((tab = malloc(tmx)) == NULL || (in = calloc(nfn + 1, 1)) == NULL ||
+        (buf = malloc(WEE_ABUF)) == NULL) {
+        perror("malloc()");
+        exit(1);
+    }
+    tln = 4;
+    for (i = 0; i < nfn; i++) {
+        if (stat(fn[i], &st)) {
+            perror(fn[i]);
+            er++;
+            continue;
+        }
+        if (!S_ISREG(st.st_mode)) {
+            fprintf(stderr, "%s: not a regular file -- ignored\n", fn[i]);
+            er++;
+            continue;
+        }
+        for (k = 0; fn[i][k] == '/'; k++)   // stored relative
+            ;
+        n = strlen(&fn[i][k]);
+        if (n == 0 || n >= WEE_ANAM) {
+            fprintf(stderr, "%s: bad file name -- ignored\n", fn[i]);
+            er++;
+            continue;
+        }
+        if (tln + n + 24 > tmx) {
+            tmx = 2 * (tln + n + 24);
+            if ((tab = realloc(tab, tmx)) == NULL) {
+                perror("realloc()");
+                exit(1);
+            }
+        }
+        wee_arc_put(&tab[tln], n, 4);
+        memcpy(&tab[tln + 4], &fn[i][k], n);
+        tln += 4 + n;
+        wee_arc_put(&tab[tln], st.st_size, 8);
+        wee_arc_put(&tab[tln + 8], st.st_mode & 07777, 4);
+        wee_arc_put(&tab[tln + 12], st.st_mtime, 8);
+        tln += 20;
+        in[i] = 1;
+        nf++;
+    }
+    wee_arc_put(tab, nf, 4);
+
+    if ((c = wee_ctx_new()) == NULL) {
+        perror("calloc()");
+        exit(1);
+    }
+
+    ret = -1;
+    isz = 0;
+    osz = 2;
+    if (strcmp(arc, "-") == 0) {
+        fout = stdout;
+    } else if ((fout = fopen(arc, "wb")) == NULL) {
+        perror(arc);
+        goto fail;
+    }
+    if (fputc(0x07, fout) == EOF || fputc(0xE3, fout) == EOF ||
+        wee_ctx_level(c, lvl) || wee_enc_begin(c) ||
+        wee_enc_push(c, tab, tln, WEE_NOFLUSH) ||
+        wee_arc_drain(c, fout, buf, &osz))
+        goto fail;
+
+    // then the contents; the table has promised their sizes
+    for (i = 0, tln = 4; i < nfn; i++) {
+        if (!in[i])
+            continue;
+        tln += 4 + wee_arc_val(&tab[tln], 4);
+        rem = wee_arc_val(&tab[tln], 8);
+        tln += 20;
+        if ((fin = fopen(fn[i], "rb")) == NULL) {
+            perror(fn[i]);
+            goto fail;
+        }
+        while (rem > 0) {
+            n = rem < WEE_ABUF ? rem : WEE_ABUF;
+            if (fread(buf, 1, n, fin) != n) {
+                fprintf(stderr, "%s: file changed while reading.\n", fn[i]);
+                fclose(fin);
+                goto fail;
+            }
+            rem -= n;
+            isz += n;
+            if (wee_enc_push(c, buf, n, WEE_NOFLUSH) ||
+                wee_arc_drain(c, fout, buf, &osz)) {
+                fclose(fin);
+                goto fail;
+            }
+        }
+        fclose(fin);
+    }
+
+    if (wee_enc_push(c, NULL, 0, WEE_FINISH) ||
+        wee_arc_drain(c, fout, buf, &osz) || fflush(fout))
+        goto fail;
+
+    if (verb) {
+        printf("%12llu %12llu  %.1f%%  %s (%u files)\n",
+            (unsigned long long) isz, (unsigned long long) osz,
+            isz > 0 ? 100.0 * ((double) isz - osz) / isz : 0.0,
+            arc, (unsigned) nf);
+    }
+    ret = 0;
+
+fail:
+    if (fout != NULL && fout != stdout)
+        fclose(fout);
+    if (ret) {
+        fprintf(stderr, "%s: archive not written.\n", arc);
+        if (fout != NULL && fout != stdout)
+            remove(arc);
+        er++;
+    }
+    wee_ctx_free(c);
+    free(buf);
+    free(in);
+    free(tab);
+
+    return er;
+}
+
+// Decode exactly len bytes of the archive stream into dst. Return nonzero
+// on failure, or if the stream ends first.
+
+static int wee_arc_get(wee_arc_t *a, void *dst, size_t len)
+{
+    uint8_t *p = dst;
+    size_t n;
+
+    for (;;) {
+        if ((n = wee_dec_pull(a->c, p, len)) == WEE_ERROR)
+            return -1;
+        p += n;
+        len -= n;
+        if (len == 0)
+            return 0;
+        if (wee_dec_end(a->c))
+            break;
+        if (a->ptr == a->len) {         // more input
+            a->ptr = 0;
+            a->len = fread(a->buf, 1, WEE_ABUF, a->f);
+            if (a->len == 0)
+                break;
+        }
+        if ((n = wee_dec_push(a->c, &a->buf[a->ptr], a->len - a->ptr)) ==
+            WEE_ERROR)
+            return -1;
+        a->ptr += n;
+    }
+    fprintf(stderr, "Unexpected end while reading.\n");
+
+    return -1;
+}
+
+// Free an archive opened with wee_arc_open().
+
+static void wee_arc_close(wee_arc_t *a)
+{
+    uint32_t i;
+
+    if (a->ent != NULL) {
+        for (i = 0; i <= a->n; i++)     // one may be half read
+            free(a->ent[i].name);
+        free(a->ent);
+    }
+    if (a->f != NULL && a->f != stdin)
+        fclose(a->f);
+    wee_ctx_free(a->c);
+    free(a->buf);
+}
+
+// Open archive "arc" ("-" for standard input) and read its file table.
+// Return nonzero on failure.
+
+static int wee_arc_open(wee_arc_t *a, const char *arc)
+{
+    wee_aent_t *e;
+    uint8_t b[20];
+    uint32_t nf;
+    size_t n, cap;
+
+    memset(a, 0, sizeof(wee_arc_t));
+    if (strcmp(arc, "-") == 0) {
+        a->f = stdin;
+    } else if ((a->f = fopen(arc, "rb")) == NULL) {
+        perror(arc);
+        return -1;
+    }
+    if ((a->buf = malloc(WEE_ABUF)) == NULL ||
+        (a->c = wee_ctx_new()) == NULL) {
+        perror("malloc()");
+        exit(1);
+    }
+    if (fread(b, 1, 2, a->f) != 2 || b[0] != 0x07 || b[1] != 0xE3) {
+        fprintf(stderr, "%s: not a wee archive.\n", arc);
+        goto fail;
+    }
+    if (wee_dec_begin(a->c) || wee_arc_get(a, b, 4))
+        goto fail;
+
+    // the count is not trusted; the table grows as entries are read and
+    // always has room for one past the last (see wee_arc_close())
+    nf = wee_arc_val(b, 4);
+    cap = 16;
+    if ((a->ent = calloc(cap, sizeof(wee_aent_t))) == NULL) {
+        perror("calloc()");
+        goto fail;
+    }
+    for (a->n = 0; a->n < nf; a->n++) {
+        if ((size_t) a->n + 1 >= cap) {
+            if ((e = realloc(a->ent, 2 * cap * sizeof(wee_aent_t))) == NULL) {
+                perror("realloc()");
+                goto fail;
+            }
+            memset(&e[cap], 0, cap * sizeof(wee_aent_t));
+            a->ent = e;
+            cap *= 2;
+        }
+        e = &a->ent[a->n];
+        if (wee_arc_get(a, b, 4))
+            goto fail;
+        n = wee_arc_val(b, 4);
+        if (n == 0 || n >= WEE_ANAM || (e->name = malloc(n + 1)) == NULL) {
+            fprintf(stderr, "%s: invalid file table.\n", arc);
+            goto fail;
+        }
+        if (wee_arc_get(a, e->name, n) || wee_arc_get(a, b, 20))
+            goto fail;
+        e->name[n] = 0;
+        e->size = wee_arc_val(b, 8);
+        e->mode = wee_arc_val(&b[8], 4);
+        e->mtime = wee_arc_val(&b[12], 8);
+    }
+
+    return 0;
+
+fail:
+    wee_arc_close(a);
+
+    return -1;
+}
+
+// List the files in archive "arc" ("-" for standard input); with "verb"
+// also modes, sizes and times. Return nonzero on failure.
+
+int wee_arc_list(const char *arc, int verb)
+{
+    wee_arc_t a;
+    wee_aent_t *e;
+    struct tm *lt;
+    char tm[32];
+    time_t t;
+    uint32_t i;
+
+    if (wee_arc_open(&a, arc))
+        return -1;
+    for (i = 0; i < a.n; i++) {
+        e = &a.ent[i];
+        if (verb) {
+            t = e->mtime;
+            if ((lt = localtime(&t)) == NULL ||
+                strftime(tm, sizeof(tm), "%Y-%m-%d %H:%M", lt) == 0)
+                strcpy(tm, "----------------"); // out of range
+            printf("%04o %12llu %s ", (unsigned) e->mode,
+                (unsigned long long) e->size, tm);
+        }
+        printf("%s\n", e->name);
+    }
+    wee_arc_close(&a);
+
+    return 0;
+}
+
+// Names from the archive are written only below the current directory.
+
+static int wee_arc_safe(const char *s)
+{
+    if (*s == '/')
+        return 0;
+    while (*s != 0) {
+        if (s[0] == '.' && s[1] == '.' && (s[2] == '/' || s[2] == 0))
+            return 0;
+        while (*s != 0 && *s++ != '/')  // next component
+            ;
+    }
+
+    return 1;
+}
+
+// Create the directories leading to file "name". Return nonzero on failure.
+
+static int wee_arc_mkdirs(char *name)
+{
+    char *p;
+
+    for (p = strchr(name, '/'); p != NULL; p = strchr(p + 1, '/')) {
+        *p = 0;
+        if (p > name && mkdir(name, 0777) && errno != EEXIST) {
+            perror(name);
+            *p = '/';
+            return -1;
+        }
+        *p = '/';
+    }
+
+    return 0;
+}
+
+// Extract files fn[nfn] (all if nfn is 0) from archive "arc" ("-" for
+// standard input) into the current directory, or to standard output if
+// "stdo". Decoding stops after the last file wanted. Return the number of
+// errors.
+
+int wee_arc_ext(const char *arc, char **fn, size_t nfn, int stdo, int verb)
+{
+    wee_arc_t a;
+    wee_aent_t *e;
+    FILE *fout;
+    struct utimbuf ut;
+    uint8_t *buf;
+    char *got;
+    uint32_t i, last;
+    uint64_t rem;
+    size_t k, n;
+    int er, want;
+
+    if (wee_arc_open(&a, arc))
+        return 1;
+    if ((buf = malloc(WEE_ABUF)) == NULL ||
+        (got = calloc(nfn + 1, 1)) == NULL) {
+        perror("malloc()");
+        exit(1);
+    }
+
+    // mark the files wanted
+    er = 0;
+    last = nfn == 0 ? a.n : 0;
+    for (k = 0; k < nfn; k++) {
+        for (i = 0; i < a.n && strcmp(a.ent[i].name, fn[k]) != 0; i++)
+            ;
+        if (i < a.n) {
+            got[k] = 1;
+            if (i >= last)
+                last = i + 1;
+        } else {
+            fprintf(stderr, "%s: not in %s\n", fn[k], arc);
+            er++;
+        }
+    }
+
+    for (i = 0; i < last; i++) {
+        e = &a.ent[i];
+        want = nfn == 0;
+        for (k = 0; k < nfn && !want; k++)
+            want = got[k] && strcmp(e->name, fn[k]) == 0;
+
+        fout = NULL;
+        if (want && stdo) {
+            fout = stdout;
+        } else if (want && !wee_arc_safe(e->name)) {
+            fprintf(stderr, "%s: unsafe file name -- skipped\n", e->name);
+            er++;
+        } else if (want && (wee_arc_mkdirs(e->name) ||
+            (fout = fopen(e->name, "wb")) == NULL)) {
+            perror(e->name);
+            er++;
+        }
+
+        // decode the contents; skipped if not wanted
+        for (rem = e->size; rem > 0; rem -= n) {
+            n = rem < WEE_ABUF ? rem : WEE_ABUF;
+            if (wee_arc_get(&a, buf, n)) {
+                er++;
+                last = 0;               // corrupt; stop here
+                break;
+            }
+            if (fout != NULL && fwrite(buf, 1, n, fout) != n) {
+                perror(e->name);
+                er++;
+                if (fout != stdout)
+                    fclose(fout);
+                fout = NULL;
+            }
+        }
+
+        if (fout != NULL && fout != stdout) {
+            fclose(fout);
+            chmod(e->name, e->mode & 07777);
+            ut.actime = e->mtime;
+            ut.modtime = e->mtime;
+            utime(e->name, &ut);
+        }
+        if (want && verb && last > 0)
+            printf("%12llu  %s\n", (unsigned long long) e->size, e->name);
+    }
+
+    wee_arc_close(&a);
+    free(got);
+    free(buf);
+
+    return er;
+}
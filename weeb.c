@@ -0,0 +1,276 @@
+// weeb.c
+// In-memory benchmark; repeated round trips through the buffer API.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "weei.h"
+
+#define WEE_BMAX 16                     // values per swept parameter
+
+// Totals of one parameter setting over all files.
+
+typedef struct {
+    size_t      blk;                    // block size, 0 = whole file
+    uint32_t    dep, nic;               // search depth, nice length
+    uint64_t    isz, osz;               // input and output bytes
+    double      ct, dt;                 // compression, decompression time
+} wee_bset_t;
+
+// Monotonic wall clock in seconds.
+
+static double wee_bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+// Peak resident set size of the process in MiB.
+
+static double wee_bench_rss(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+
+    return ru.ru_maxrss / 1024.0;       // kilobytes on Linux
+}
+
+// Parse a comma separated list of sizes with optional K, M, G suffixes
+// into v[WEE_BMAX]. Return the number of values, or 0 on error.
+
+static int wee_bench_list(const char *s, uint64_t *v)
+{
+    char *t;
+    int n;
+
+    if (s == NULL) {                    // default
+        v[0] = 0;
+        return 1;
+    }
+
+    for (n = 0; n < WEE_BMAX; n++) {
+        v[n] = strtoull(s, &t, 0);
+        if (t == s)
+            return 0;
+        switch (*t) {
+            case 'G': case 'g':
+                v[n] <<= 10;
+            case 'M': case 'm':
+                v[n] <<= 10;
+            case 'K': case 'k':
+                v[n] <<= 10;
+                t++;
+        }
+        if (*t == 0)
+            return n + 1;
+        if (*t != ',')
+            return 0;
+        s = t + 1;
+    }
+
+    return 0;
+}
+
+// Print a parameter value; zero is the built-in default.
+
+static void wee_bench_par(uint64_t x, int w)
+{
+    if (x == 0)
+        printf(" %*s", w, "-");
+    else if (x % (1 << 20) == 0)
+        printf(" %*lluM", w - 1, (unsigned long long) (x >> 20));
+    else if (x % (1 << 10) == 0)
+        printf(" %*lluK", w - 1, (unsigned long long) (x >> 10));
+    else
+        printf(" %*llu", w, (unsigned long long) x);
+}
+
+// Print one result line.
+
+static void wee_bench_line(const wee_bset_t *b, const char *name)
+{
+    wee_bench_par(b->blk, 6);
+    wee_bench_par(b->dep, 4);
+    wee_bench_par(b->nic, 4);
+    printf(" %11llu %11llu %5.1f%% %8.2f %8.2f %7.1f  %s\n",
+        (unsigned long long) b->isz, (unsigned long long) b->osz,
+        b->isz > 0 ? 100.0 - (100.0 * b->osz) / b->isz : 0.0,
+        b->ct > 0 ? 1E-6 * b->isz / b->ct : 0.0,
+        b->dt > 0 ? 1E-6 * b->isz / b->dt : 0.0,
+        wee_bench_rss(), name);
+}
+
+// Round trip buf[len] in independent blocks "iter" times, verifying the
+// result. The best times are stored in b. Return nonzero on failure.
+
+static int wee_bench_run(wee_ctx_t *c, const uint8_t *buf, size_t len,
+    int iter, wee_bset_t *b)
+{
+    uint8_t *cmp, *out;
+    size_t blk, nb, i, n, cap, *csz;
+    double t, ct, dt;
+    int k, ret;
+
+    blk = b->blk == 0 || b->blk > len ? len : b->blk;
+    nb = blk == 0 ? 1 : (len + blk - 1) / blk;
+    cap = blk + blk / 8 + 64;           // worst case expansion is ~3%
+
+    cmp = malloc(nb * cap);
+    out = malloc(len + 1);
+    csz = malloc(nb * sizeof(size_t));
+    if (cmp == NULL || out == NULL || csz == NULL) {
+        perror("malloc()");
+        exit(1);
+    }
+
+    ret = -1;
+    ct = 0.0;
+    dt = 0.0;
+    for (k = 0; k < iter; k++) {
+
+        t = wee_bench_now();
+        b->osz = 0;
+        for (i = 0; i < nb; i++) {
+            n = len - i * blk < blk ? len - i * blk : blk;
+            csz[i] = wee_compress(c, &cmp[i * cap], cap, &buf[i * blk], n);
+            if (csz[i] == WEE_ERROR) {
+                fprintf(stderr, "Compression failed.\n");
+                goto fail;
+            }
+            b->osz += csz[i];
+        }
+        t = wee_bench_now() - t;
+        if (k == 0 || t < ct)
+            ct = t;
+
+        memset(out, 0, len);
+        t = wee_bench_now();
+        for (i = 0; i < nb; i++) {
+            n = len - i * blk < blk ? len - i * blk : blk;
+            if (wee_decompress(c, &out[i * blk], n, &cmp[i * cap],
+                csz[i]) != n) {
+                fprintf(stderr, "Decompression failed.\n");
+                goto fail;
+            }
+        }
+        t = wee_bench_now() - t;
+        if (k == 0 || t < dt)
+            dt = t;
+
+        if (memcmp(buf, out, len) != 0) {
+            fprintf(stderr, "Round trip mismatch.\n");
+            goto fail;
+        }
+    }
+    b->isz = len;
+    b->ct = ct;
+    b->dt = dt;
+    ret = 0;
+
+fail:
+    free(csz);
+    free(out);
+    free(cmp);
+
+    return ret;
+}
+
+// Benchmark files fn[nfn] at level "lvl" with "iter" round trips for
+// every combination of the comma separated lists of block sizes, search
+// depths and nice lengths (NULL for defaults). Return the number of errors.
+
+int wee_bench(char **fn, int nfn, int lvl, int iter, const char *blks,
+    const char *deps, const char *nics)
+{
+    uint64_t vb[WEE_BMAX], vd[WEE_BMAX], vn[WEE_BMAX];
+    int nb, nd, nn, ns, i, j, er;
+    wee_bset_t *set, b;
+    wee_ctx_t *c;
+    uint8_t *buf;
+    size_t len;
+    FILE *f;
+
+    nb = wee_bench_list(blks, vb);
+    nd = wee_bench_list(deps, vd);
+    nn = wee_bench_list(nics, vn);
+    if (nb == 0 || nd == 0 || nn == 0) {
+        fprintf(stderr, "Invalid benchmark parameter list.\n");
+        return 1;
+    }
+
+    ns = nb * nd * nn;
+    if ((set = calloc(ns, sizeof(wee_bset_t))) == NULL ||
+        (c = wee_ctx_new()) == NULL) {
+        perror("calloc()");
+        exit(1);
+    }
+    for (i = 0; i < ns; i++) {
+        set[i].blk = vb[i / (nd * nn)];
+        set[i].dep = vd[(i / nn) % nd];
+        set[i].nic = vn[i % nn];
+    }
+
+    printf("%6s %4s %4s %11s %11s %6s %8s %8s %7s  %s\n", "block", "dep",
+        "nic", "size", "wee", "ratio", "comp", "dec", "rss", "file");
+    printf("%6s %4s %4s %11s %11s %6s %8s %8s %7s\n", "", "", "", "bytes",
+        "bytes", "", "MB/s", "MB/s", "MiB");
+
+    er = 0;
+    for (j = 0; j < nfn; j++) {
+
+        // the whole file in memory
+        if ((f = fopen(fn[j], "rb")) == NULL) {
+            perror(fn[j]);
+            er++;
+            continue;
+        }
+        fseeko(f, 0, SEEK_END);
+        len = ftello(f);
+        fseeko(f, 0, SEEK_SET);
+        if ((buf = malloc(len + 1)) == NULL) {
+            perror("malloc()");
+            exit(1);
+        }
+        if (fread(buf, 1, len, f) != len) {
+            perror(fn[j]);
+            fclose(f);
+            free(buf);
+            er++;
+            continue;
+        }
+        fclose(f);
+
+        for (i = 0; i < ns; i++) {
+            b = set[i];
+            if (wee_ctx_level(c, lvl) || wee_ctx_tune(c, b.dep, b.nic) ||
+                wee_bench_run(c, buf, len, iter, &b)) {
+                fprintf(stderr, "%s: benchmark failed.\n", fn[j]);
+                er++;
+                continue;
+            }
+            wee_bench_line(&b, fn[j]);
+            set[i].isz += b.isz;
+            set[i].osz += b.osz;
+            set[i].ct += b.ct;
+            set[i].dt += b.dt;
+        }
+        free(buf);
+    }
+
+    if (nfn > 1) {
+        for (i = 0; i < ns; i++)
+            wee_bench_line(&set[i], "TOTAL");
+    }
+
+    wee_ctx_free(c);
+    free(set);
+
+    return er;
+}
@@ -5,7 +5,7 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "wee.h"
+#include "weei.h"
 
 #ifndef WEE_BLK
 #define WEE_BLK 0x100000
@@ -17,9 +17,65 @@
 #define WEE_SRT 0x100
 #endif
 
+#ifndef WEE_DEPTH
+#define WEE_DEPTH 32
+#endif
+#ifndef WEE_NICE
+#define WEE_NICE 128
+#endif
+#ifndef WEE_SCAN
+#define WEE_SCAN 256                    // block sort neighbours, plus one
+#endif
+
+#ifndef WEE_PROB
+#define WEE_PROB 1
+#endif
+#ifndef WEE_FLIM
+#define WEE_FLIM 7                      // log2 count limit, literals
+#endif
+#ifndef WEE_FLIM6
+#define WEE_FLIM6 8                     // .. lengths and offsets
+#endif
+
 #define WEE_MINDICT 5
 #define WEE_OFHIST 5
 
+// Parsers: take the longest match, look one position ahead first, or
+// choose the cheapest path through a window by estimated bit prices.
+
+#define WEE_GREEDY 0
+#define WEE_LAZY 1
+#define WEE_OPTIMAL 2
+
+#ifndef WEE_OPTN
+#define WEE_OPTN 0x1000                 // optimal parse window, at most
+#endif
+#ifndef WEE_OPTR
+#define WEE_OPTR 0x100                  // .. symbol price refresh interval
+#endif
+
+// Compression levels; hash chains instead of the tree, search depth
+// (probes in block sort builds), nice length, dictionary window, minimum
+// match length and parser. The default level WEE_LEVEL matches the
+// compile-time settings above.
+
+static const struct {
+    uint32_t    hc, dep, scn, nic, win, min, par;
+} wee_lvl[10] = {
+    { 0, 0, 0, 0, 0, 0, 0 },            // unused
+    { 1, 2, 8, 16, WEE_BLK / 8, 6, WEE_GREEDY },
+    { 1, 8, 16, 32, WEE_BLK / 4, 6, WEE_GREEDY },
+    { 0, 8, 32, 32, WEE_BLK / 2, 5, WEE_GREEDY },
+    { 0, 16, 64, 64, WEE_BLK, 5, WEE_GREEDY },
+    { 0, 24, 128, 96, WEE_BLK, 5, WEE_GREEDY },
+    { 0, WEE_DEPTH, WEE_SCAN, WEE_NICE, WEE_BLK, WEE_MINDICT, WEE_GREEDY },
+    { 0, 64, 512, 192, WEE_BLK, 7, WEE_LAZY },
+    { 0, 96, 1024, 256, WEE_BLK, 7, WEE_LAZY },
+    { 0, 192, 4096, 273, WEE_BLK, 4, WEE_OPTIMAL }
+};
+
+#ifdef WEE_QSORT
+
 // Comparator for an array of pointers
 
 static int wee_compar(const void *a, const void *b)
@@ -31,13 +87,33 @@ static int wee_compar(const void *a, const void *b)
     return d;
 }
 
-// Return number of byte positions where two strings are equal
+#endif
+
+// Return number of byte positions where two strings are equal. Compares
+// a word at a time; the first difference is the lowest set bit of the XOR.
 
-static int wee_equ(const uint8_t *a, const uint8_t *b, int n)
+static int wee_equ_w64(const uint8_t *a, const uint8_t *b, int n)
 {
     int i;
+#if defined(__GNUC__) && defined(__BYTE_ORDER__)
+    uint64_t x, y;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        memcpy(&x, &a[i], 8);
+        memcpy(&y, &b[i], 8);
+        if (x != y) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            return i + (__builtin_ctzll(x ^ y) >> 3);
+#else
+            return i + (__builtin_clzll(x ^ y) >> 3);
+#endif
+        }
+    }
+#else
+    i = 0;
+#endif
 
-    for (i = 0; i < n; i++) {
+    for (; i < n; i++) {
         if (a[i] != b[i])
             return i;
     }
@@ -45,6 +121,66 @@ static int wee_equ(const uint8_t *a, const uint8_t *b, int n)
     return n;
 }
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+
+// SSE2 and AVX2 versions; compare mask bits are set for equal bytes.
+
+__attribute__((target("sse2")))
+static int wee_equ_sse2(const uint8_t *a, const uint8_t *b, int n)
+{
+    __m128i x, y;
+    uint32_t m;
+    int i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        x = _mm_loadu_si128((const __m128i *) &a[i]);
+        y = _mm_loadu_si128((const __m128i *) &b[i]);
+        m = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xFFFF;
+        if (m != 0)
+            return i + __builtin_ctz(m);
+    }
+
+    return i + wee_equ_w64(&a[i], &b[i], n - i);
+}
+
+__attribute__((target("avx2")))
+static int wee_equ_avx2(const uint8_t *a, const uint8_t *b, int n)
+{
+    __m256i x, y;
+    uint32_t m;
+    int i;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        x = _mm256_loadu_si256((const __m256i *) &a[i]);
+        y = _mm256_loadu_si256((const __m256i *) &b[i]);
+        m = ~(uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+        if (m != 0)
+            return i + __builtin_ctz(m);
+    }
+
+    return i + wee_equ_w64(&a[i], &b[i], n - i);
+}
+#define WEE_EQU_X86
+#endif
+
+// Match length kernel; picked by CPU features in wee_equ_sel().
+
+static int (*wee_equ)(const uint8_t *a, const uint8_t *b, int n) =
+    wee_equ_w64;
+static pthread_once_t wee_equ_once = PTHREAD_ONCE_INIT;
+
+static void wee_equ_sel(void)
+{
+#ifdef WEE_EQU_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        wee_equ = wee_equ_avx2;
+    else if (__builtin_cpu_supports("sse2"))
+        wee_equ = wee_equ_sse2;
+#endif
+}
+
 // simple log2
 
 static int wee_log2(uint32_t x)
@@ -60,7 +196,11 @@ static int wee_log2(uint32_t x)
     return l;
 }
 
-void dbg_64(uint8_t *pt)
+#ifdef WEE_DEBUG
+
+// Dump 64 bytes at pt as text, for debugging.
+
+static void dbg_64(uint8_t *pt)
 {
     int i, ch;
 
@@ -73,387 +213,2363 @@ void dbg_64(uint8_t *pt)
     printf("\n");
 }
 
+#endif
+
+// Adaptive models for literals and lengths; either binary frequency
+// counts or division-free probabilities (magic 07 E1). Counts grow without
+// bound in the original format (magic 07 E0). With magic 07 E4 two bytes
+// follow, the log2 limits for literals and for lengths and offsets; a
+// node whose total exceeds its limit has both counts halved.
+
+typedef struct {
+    int         pro;                    // probabilities instead of counts
+    uint8_t     lim[2];                 // log2 count limits, 0 = none
+} wee_cod_t;
+
+static const wee_cod_t wee_cod_prob = { 1, { 0, 0 } };
+
+// Second magic byte of a stream, by coder id (see wee_cod_id()).
+
+static const uint8_t wee_cod_mag[3] = { 0xE0, 0xE1, 0xE4 };
+
+// Coder id: 0 unbounded counts, 1 probabilities, 2 limited counts.
+
+static int wee_cod_id(const wee_cod_t *cod)
+{
+    if (cod->pro)
+        return 1;
+
+    return cod->lim[0] != 0 || cod->lim[1] != 0 ? 2 : 0;
+}
+
+// Set coder "cod" from its id and, for id 2, limits lim[2]. Return
+// nonzero if they are invalid.
+
+static int wee_cod_set(wee_cod_t *cod, int id, const uint8_t lim[2])
+{
+    if (id < 0 || id > 2 || (id == 2 && (lim[0] > 30 || lim[1] > 30)))
+        return -1;
+    cod->pro = id == 1;
+    cod->lim[0] = id == 2 ? lim[0] : 0;
+    cod->lim[1] = id == 2 ? lim[1] : 0;
+
+    return 0;
+}
+
+// Write the coder id (or stream magic byte "mag") of "cod" and its
+// limits to p[3]. Return the number of bytes.
+
+static size_t wee_cod_put(uint8_t *p, const wee_cod_t *cod, int mag)
+{
+    int id;
+
+    id = wee_cod_id(cod);
+    p[0] = mag ? wee_cod_mag[id] : id;
+    if (id != 2)
+        return 1;
+    p[1] = cod->lim[0];
+    p[2] = cod->lim[1];
+
+    return 3;
+}
+
+// Read the limits that follow coder id "id" in "fin" into "cod". Return
+// nonzero on failure.
+
+static int wee_cod_rd(FILE *fin, int id, wee_cod_t *cod)
+{
+    uint8_t lim[2] = { 0, 0 };
+
+    if (id == 2 && fread(lim, 1, 2, fin) != 2)
+        return -1;
+
+    return wee_cod_set(cod, id, lim);
+}
+
+// Coder id of stream magic byte "mag", or -1.
+
+static int wee_cod_mid(int mag)
+{
+    int id;
+
+    for (id = 0; id < 3; id++) {
+        if (wee_cod_mag[id] == mag)
+            return id;
+    }
+
+    return -1;
+}
+
+#define WEE_RUN 0                       // literal run lengths
+#define WEE_OFS 1                       // repeat string offsets
+#define WEE_LEN 2                       // repeat string lengths
+
+// Probabilities for literals go by nibble: a tree of 15 nodes for the
+// high nibble, then one of 16 trees for the low one. Each tree fills 32
+// aligned bytes, so a literal touches two cache lines rather than four.
+// The nodes are the same as in a plain 8-bit tree; so is the coding.
+
+#define WEE_PLIT (17 * 16)              // literal nodes per context
+
+// The literal tables are allocated for the coder in use only: 136 kB of
+// probabilities, or 512 kB of counts.
+
+typedef struct {
+    uint16_t    (*p8x8)[WEE_PLIT];      // literal probabilities, or NULL
+    uint32_t    (*f8x8)[0x100][2];      // .. counts, or NULL
+    uint32_t    fr6[3][0x40][2];        // lengths and offsets
+    uint16_t    pr6[3][0x40];           // .. as probabilities
+    int         pro;                    // probabilities instead of counts
+    uint32_t    flim[2];                // count limits; ~0 for none
+} wee_mod_t;
+
+// Free the literal tables.
+
+static void wee_mod_free(wee_mod_t *m)
+{
+    free(m->p8x8);
+    free(m->f8x8);
+    m->p8x8 = NULL;
+    m->f8x8 = NULL;
+}
+
+// Initialize models for coder "cod"; the literal tables are replaced if
+// they were for the other coder. Return nonzero on failure.
+
+static int wee_mod_init(wee_mod_t *m, const wee_cod_t *cod)
+{
+    int i, j, pro;
+
+    pro = cod->pro;
+    if (pro ? m->p8x8 == NULL : m->f8x8 == NULL) {
+        wee_mod_free(m);                // sizes are multiples of 64
+        if (pro)
+            m->p8x8 = aligned_alloc(64, 0x100 * sizeof(*m->p8x8));
+        else
+            m->f8x8 = aligned_alloc(64, 0x100 * sizeof(*m->f8x8));
+        if (m->p8x8 == NULL && m->f8x8 == NULL) {
+            perror("aligned_alloc()");
+            return -1;
+        }
+    }
+    m->pro = pro;
+    for (i = 0; i < 2; i++)             // no limit: never halved
+        m->flim[i] = cod->lim[i] ? (uint32_t) 1 << cod->lim[i] : ~0u;
+    for (i = 0; i < 0x100; i++) {
+        if (pro) {
+            for (j = 0; j < 17; j++)
+                aric_probinit(&m->p8x8[i][16 * j], 4);
+        } else {
+            aric_freqinit(m->f8x8[i], 8);
+        }
+    }
+    for (i = 0; i < 3; i++) {
+        if (pro)
+            aric_probinit(m->pr6[i], 6);
+        else
+            aric_freqinit(m->fr6[i], 6);
+    }
+
+    return 0;
+}
+
+// Encode a literal a after byte b.
+
+static inline void wee_enc_lit8(aric_rb_t *rbo, wee_mod_t *m, int a, int b)
+{
+    if (m->pro)
+        aric_encp8(rbo, a, m->p8x8[b]);
+    else
+        aric_encf8(rbo, a, m->f8x8[b], m->flim[0]);
+}
+
+// Decode a literal after byte b.
+
+static inline int wee_dec_lit8(aric_rb_t *rbi, wee_mod_t *m, int b)
+{
+    if (m->pro)                         // (~0 when out of input)
+        return aric_decp8(rbi, m->p8x8[b]) & 0xFF;
+
+    return aric_decf8(rbi, m->f8x8[b], m->flim[0]) & 0xFF;
+}
+
+// Encode a 6-bit length symbol.
+
+static inline void wee_enc_sym6(aric_rb_t *rbo, wee_mod_t *m, int sel,
+    uint32_t x)
+{
+    if (m->pro)
+        aric_encp6(rbo, x, m->pr6[sel]);
+    else
+        aric_encf6(rbo, x, m->fr6[sel], m->flim[1]);
+}
+
+// Decode a 6-bit length symbol.
+
+static inline uint32_t wee_dec_sym6(aric_rb_t *rbi, wee_mod_t *m, int sel)
+{
+    if (m->pro)
+        return aric_decp6(rbi, m->pr6[sel]);
+
+    return aric_decf6(rbi, m->fr6[sel], m->flim[1]);
+}
+
 // Encode a length.
 
-void wee_enc_len(aric_rb_t *rbo, int l, uint32_t fr6[0x40][2])
+static void wee_enc_len(aric_rb_t *rbo, int l, wee_mod_t *m, int sel)
 {
     uint32_t x;
 
     if (l < 0) {                        // 33..36 are for special codes
-        x = 32 - l;
-        aric_enc(rbo, x, fr6, 6);
-        aric_addfreq(fr6, 6, x);
+        wee_enc_sym6(rbo, m, sel, 32 - l);
         return;
     }
 
     if (l <= 32) {                      // short ?
-        aric_enc(rbo, l, fr6, 6);
-        aric_addfreq(fr6, 6, l);
+        wee_enc_sym6(rbo, m, sel, l);
     } else {
         x = wee_log2(l);                // encode bit length
-        aric_enc(rbo, x + 32, fr6, 6);
-        aric_addfreq(fr6, 6, x + 32);
-        aric_enc(rbo, l, NULL, x - 1);  // actual bits
+        wee_enc_sym6(rbo, m, sel, x + 32);
+        if (m->pro)                     // actual bits
+            aric_encd(rbo, l, x - 1);
+        else
+            aric_enc(rbo, l, NULL, x - 1);
     }
 }
 
 // Decode a length.
 
-int wee_dec_len(aric_rb_t *rbi, uint32_t fr6[0x40][2])
+static int wee_dec_len(aric_rb_t *rbi, wee_mod_t *m, int sel)
 {
     uint32_t x, l;
 
-    x = aric_dec(rbi, fr6, 6);          // decode
-    aric_addfreq(fr6, 6, x);
+    x = wee_dec_sym6(rbi, m, sel);      // decode
 
     if (x <= 32)                        // plain value
         return x;
+    if (x > 0x3F)                       // ran out of input; caller checks
+        return 0;
 
     x -= 32;
     if (x < 5)                          // special codes
         return -x;
-    l = aric_dec(rbi, NULL, x - 1);     // get bits
+    if (m->pro)                         // get bits
+        l = aric_decd(rbi, x - 1);
+    else
+        l = aric_dec(rbi, NULL, x - 1);
     l |= 1 << (x - 1);                  // leading 1
 
     return l;
 }
 
-// Compress "fin" to "fout".
+// Bit prices for the optimal parser, in 1/WEE_PONE bits. wee_pcost[k] is
+// the price of a bit whose probability is about k / 256.
 
-size_t wee_file_enc(FILE *fin, FILE *fout, int verb)
-{
-    // input buffer
-    uint8_t     *din;                   // input buffer
-    uint32_t    dip, dil;               // input pointer, len
-    uint8_t     dou[WEE_BUF + 2 * 64];  // note: 64B surety at both ends
-    aric_rb_t   rbo;                    // range buffer (out)
-    uint32_t    f8x8[0x100][0x100][2];  // for literals
-    uint32_t    fr6l[0x40][2];          // literal run lengths
-    uint32_t    fr6o[0x40][2];          // repeat string offsets
-    uint32_t    fr6s[0x40][2];          // repeat string lengths
-    size_t      isz, osz;               // input and output size
+#define WEE_PFRAC 5
+#define WEE_PONE (1 << WEE_PFRAC)
 
-    uint8_t     **srt;                  // sorted pointers
-    uint32_t    *idx;                   // reverse index
+static uint32_t wee_pcost[0x101];
+static pthread_once_t wee_pcost_once = PTHREAD_ONCE_INIT;
 
-    size_t      sle;                    // sorted len
-    size_t      i;
-    uint32_t    x, y, z, j;             // work variables
-    uint32_t    ble, bof, lit;          // match len, offset, literal run
-    uint32_t    pof[WEE_OFHIST];        // previous offsets
-    int         l, a, b;                // len, current and previous bytes
+// log2(x) in 1/WEE_PONE units, for 1 <= x <= 0x100.
 
-    if ((din = calloc(3 * WEE_BLK, sizeof(uint8_t))) == NULL ||
-        (srt = calloc(2 * WEE_BLK, sizeof(uint8_t *))) == NULL ||
-        (idx = calloc(2 * WEE_BLK, sizeof(uint32_t))) == NULL) {
-        perror("calloc()");
-        exit(1);                        // no point continuing
+static uint32_t wee_plog(uint32_t x)
+{
+    uint64_t y;
+    uint32_t l;
+    int i;
+
+    y = (uint64_t) x << 16;             // 16.16 fixed point
+    l = 0;
+    while (y >= (2 << 16)) {
+        y >>= 1;
+        l += WEE_PONE;
+    }
+    for (i = WEE_PONE >> 1; i > 0; i >>= 1) {
+        y = (y * y) >> 16;              // square; a bit of the fraction
+        if (y >= (2 << 16)) {
+            y >>= 1;
+            l += i;
+        }
     }
 
-    fputc(0x07, fout);                  // magic "2016"
-    fputc(0xE0, fout);
+    return l;
+}
 
-    for (i = 0; i < 0x100; i++)         // init frequencies
-        aric_freqinit(f8x8[i], 8);
-    aric_freqinit(fr6l, 6);
-    aric_freqinit(fr6o, 6);
-    aric_freqinit(fr6s, 6);
+static void wee_pcost_init(void)
+{
+    uint32_t k;
 
-    for (i = 0; i < WEE_OFHIST; i++)    // previous offsets
-        pof[i] = 0;
+    wee_pcost[0] = 9 * WEE_PONE;        // clamp; never quite impossible
+    for (k = 1; k <= 0x100; k++)
+        wee_pcost[k] = 8 * WEE_PONE - wee_plog(k);
+}
 
-    dip = 0;                            // input pointer
-    dil = 0;                            // input length
-    isz = 0;                            // input size
-    osz = 2;                            // bytes written (magic)
-    lit = 0;                            // literal run
+// Estimated price of "bits"-sized word x in the given tree of adaptive
+// probabilities (prob) or binary frequencies (freq).
 
-    a = 0x00;                           // current and previous bytes
-    b = 0x00;
+static uint32_t wee_price(int pro, const uint16_t prob[],
+    uint32_t freq[][2], uint32_t x, int bits)
+{
+    uint32_t p, s, t;
+    int i, y;
+
+    s = 0;
+    t = 1;
+    for (i = bits - 1; i >= 0; i--) {
+        y = (x >> i) & 1;
+        if (pro) {
+            p = prob[t] >> 8;           // probability of 0 in 8 bits
+            t = (t << 1) | y;
+        } else {
+            t = (x & (~1u << i)) | (1u << i);
+            p = ((uint64_t) freq[t][0] << 8) /
+                ((uint64_t) freq[t][0] + freq[t][1]);
+        }
+        s += wee_pcost[y ? 0x100 - p : p];
+    }
 
-    memset(dou, 0x00, sizeof(dou));     // output buffer
-    aric_init_rb(&rbo, dou, sizeof(dou), 0);
+    return s;
+}
 
-    while (dip <= dil) {
+// Cost of literal a after byte b; two nibbles with probabilities.
 
-        // read as much as possible
-        i = fread(&din[dil], 1, (3 * WEE_BLK) - dil, fin);
-        isz += i;
-        dil += i;
+static inline uint32_t wee_lit_price(wee_mod_t *m, uint32_t a, int b)
+{
+    if (m->pro)
+        return wee_price(1, m->p8x8[b], NULL, a >> 4, 4) +
+            wee_price(1, &m->p8x8[b][16 + (a & 0xF0)], NULL, a & 0xF, 4);
 
-        if (dip >= dil)
-            break;
+    return wee_price(0, NULL, m->f8x8[b], a, 8);
+}
 
-        // clear rest
-        memset(&din[dil], 0x00, (3 * WEE_BLK) - dil);
+#ifdef WEE_STATS
+#include <math.h>
+#include <time.h>
+
+// Encoder statistics, compiled in with -DWEE_STATS and shown with -v.
+// Times are in seconds; bits are measured from the coder state.
+
+typedef struct {
+    double      tr, ts, tm;             // time: read, sort, match search
+    double      tl, tc, to;             // .. literals, symbols, output
+    double      bl, bn, bo;             // bits: literals, lengths, offsets
+    uint64_t    pos;                    // positions searched
+    uint64_t    pup, pdn;               // .. block sort probes up, down
+    uint64_t    mat, mln;               // matches and their total length
+    uint64_t    lit;                    // literals
+    uint64_t    ohi;                    // offset history hits
+} wee_stats_t;
+
+// A point in time, output bits and output time.
+
+typedef struct {
+    double      t, b, o;
+} wee_stm_t;
+
+#define WEE_ST(x) x
+#else
+#define WEE_ST(x)
+#endif
 
-        sle = 2 * WEE_BLK;              // sort
-        if (dil < sle)
-            sle = dil;
-        for (i = 0; i < sle; i++)
-            srt[i] = &din[i];
-        qsort(srt, sle, sizeof(uint8_t *), wee_compar);
+// Encoder state; input and output are either files or memory.
 
-        for (i = 0; i < sle; i++) {     // index
-            idx[srt[i] - din] = i;
-        }
+typedef struct {
+    wee_mod_t   mod;                    // models
+    aric_rb_t   rbo;                    // range buffer (out)
+    FILE        *fin, *fout;            // files, NULL for memory
+    const uint8_t *mem;                 // memory input
+    size_t      mep, mel;               // .. its pointer and length
+    size_t      isz, osz;               // input and output size
+    uint32_t    dip, dil;               // window pointer and length
+    uint32_t    lit;                    // literal run
+    uint32_t    pof[WEE_OFHIST];        // previous offsets
+    int         b;                      // previous byte
+    int         eof;                    // no input beyond dil will follow
+    int         done;                   // stream finished
+    uint32_t    rfr;                    // positions to optimal price refresh
+#ifdef WEE_STATS
+    wee_stats_t st;                     // statistics
+    wee_stm_t   stm;                    // .. last mark
+#endif
+} wee_enc_t;
 
-        while (dip < dil && dip < 2 * WEE_BLK) {
+#ifdef WEE_STATS
 
-            x = idx[dip];               // find the best match
-            ble = 0;
-            bof = 0;
+static double wee_st_now(void)
+{
+    struct timespec ts;
 
-            // scan up
-            for (j = 1; j < 256 && j <= x; j++) {
-                y = srt[x - j] - din;
-                z = wee_equ(&din[dip], &din[y], dil - dip);
-                if (z < WEE_MINDICT)
-                    break;
-                if (y < dip) {
-                    ble = z;
-                    bof = dip - y;
-                    break;
-                }
-            }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
 
-            // scan down
-            for (j = 1; j < 256 && x + j < sle; j++) {
-                y = srt[x + j] - din;
-                z = wee_equ(&din[dip], &din[y], dil - dip);
-                if (z < WEE_MINDICT || z < ble)
-                    break;
-                if (y < dip) {
-                    if (z > ble) {
-                        ble = z;
-                        bof = dip - y;
-                    }
-                    break;
-                }
-            }
+    return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
 
-            if (ble < WEE_MINDICT) {    // just proceed
+// Mark the current time and output position in bits.
 
-                dip++;
-                lit++;
+static void wee_st_mark(const wee_enc_t *e, wee_stm_t *m)
+{
+    const aric_rb_t *rb = &e->rbo;
+
+    m->t = wee_st_now();
+    m->o = e->st.to;
+    if (e->mod.pro)                     // low end has log2(range) bits left
+        m->b = 8.0 * (e->osz + rb->ptr + rb->pnd) - log2(rb->l);
+    else
+        m->b = 8.0 * (e->osz + rb->ptr);
+}
 
-            } else {                    // repeat string found
+// Add time (less output) and bits since mark m to *tim and *bit; re-mark.
 
-                // encode literals
-                wee_enc_len(&rbo, lit, fr6l);
-                for (i = 0; i < lit; i++) {
-                    a = din[dip - lit + i];
-                    aric_enc(&rbo, a, f8x8[b], 8);
-                    aric_addfreq(f8x8[b], 8, a);
-                    b = a;
-                }
-                lit = 0;
-
-                // encode length
-                wee_enc_len(&rbo, ble, fr6s);
-
-                if (ble > 0) {          // encode offset
-                    if (bof <= 32) {
-                        wee_enc_len(&rbo, bof, fr6o);
-                    } else {            // large offsets use a history feature
-                        for (l = 0; l < WEE_OFHIST; l++) {
-                            if (pof[l] == bof) {
-                                wee_enc_len(&rbo, -l, fr6o);
-                                break;
-                            }
-                        }
-                        if (l == WEE_OFHIST) {
-                            // not found in previous offsets
-                            wee_enc_len(&rbo, bof, fr6o);
-                            for (l = WEE_OFHIST - 1; l > 0; l--)
-                                pof[l] = pof[l - 1];
-                            pof[0] = bof;
-                        }
-                    }
-                    dip += ble;         // advance pointer
-                }
-            }
+static void wee_st_add(const wee_enc_t *e, wee_stm_t *m,
+    double *tim, double *bit)
+{
+    wee_stm_t n;
+
+    wee_st_mark(e, &n);
+    if (tim != NULL)
+        *tim += n.t - m->t - (n.o - m->o);
+    if (bit != NULL)
+        *bit += n.b - m->b;
+    *m = n;
+}
 
-            // output range buffer overflow ?
-            if (rbo.ptr > rbo.max - 64) {
-                i = rbo.ptr - 64;       // leave something for carry
-                if (fwrite(dou, 1, i, fout) != i) {
-                    perror("error writing");
-                    return 0;
-                }
-                osz += i;
-                rbo.ptr -= i;
-                memmove(&dou, &dou[i], rbo.ptr);
-            }
-        }
+// Print statistics.
 
-        if (dip > WEE_BLK) {            // move data back
-            i = dip - WEE_BLK;
-            dip -= i;
-            dil -= i;
-            memmove(din, &din[i], dil);
-        }
-    }
+static void wee_st_print(const wee_stats_t *st, FILE *f)
+{
+    double b;
+
+    b = st->bl + st->bn + st->bo;
+    if (b <= 0.0)
+        b = 1.0;
+    fprintf(f, "time   read %.3fs  sort %.3fs  search %.3fs  "
+        "literals %.3fs  symbols %.3fs  output %.3fs\n",
+        st->tr, st->ts, st->tm, st->tl, st->tc, st->to);
+    fprintf(f, "search %llu positions  %llu matches  avg len %.1f  "
+        "history hits %llu\n", (unsigned long long) st->pos,
+        (unsigned long long) st->mat,
+        st->mat ? (double) st->mln / st->mat : 0.0,
+        (unsigned long long) st->ohi);
+#ifdef WEE_BLOCKSORT
+    fprintf(f, "probes up %.2f  down %.2f per position\n",
+        st->pos ? (double) st->pup / st->pos : 0.0,
+        st->pos ? (double) st->pdn / st->pos : 0.0);
+#endif
+    fprintf(f, "bits   literals %.0f (%.1f%%, %.2f each)  lengths %.0f "
+        "(%.1f%%)  offsets %.0f (%.1f%%)\n",
+        st->bl, 100.0 * st->bl / b, st->lit ? st->bl / st->lit : 0.0,
+        st->bn, 100.0 * st->bn / b, st->bo, 100.0 * st->bo / b);
+}
 
-    wee_enc_len(&rbo, lit, fr6l);       // encode remaining literals
-    for (i = 0; i < lit; i++) {
-        a = din[dip - lit + i];
-        aric_enc(&rbo, a, f8x8[b], 8);
-        aric_addfreq(f8x8[b], 8, a);
-        b = a;
-    }
-    lit = 0;
-    wee_enc_len(&rbo, -1, fr6s);        // unique end symbol; runlen = -1
-    aric_final_out(&rbo);               // flush out buffer
+#endif
 
-    if (fwrite(dou, 1, rbo.ptr, fout) != rbo.ptr) {
-        perror("error writing");
-        return 0;
-    }
-    osz += rbo.ptr;
+// Decoder state
 
-    if (verb) {                         // verbose statistics
-        printf("%12zu %12zu  %.1f%%  ",
-            isz, osz, 100.0 * ((double) isz - osz) / ((double) isz));
+typedef struct {
+    wee_mod_t   mod;                    // models
+    aric_rb_t   rbi;                    // range buffer (in)
+    uint32_t    pof[WEE_OFHIST];        // previous offsets
+    uint32_t    lit;                    // literals left in the run
+    int         b;                      // previous byte
+    int         end;                    // end symbol seen
+    int         syn;                    // coder restarts (sync flush)
+} wee_dec_t;
+
+// Reusable context; owns the window, dictionary search and models.
+
+struct wee_ctx {
+    wee_enc_t   enc;                    // encoder state
+    wee_dec_t   dec;                    // decoder state
+    uint8_t     *din;                   // input window; dbf or the input
+    uint8_t     *dbf;                   // window buffer
+#ifdef WEE_BLOCKSORT
+    uint32_t    *srt;                   // sorted positions (suffix array)
+    uint32_t    *idx;                   // reverse index
+#else
+    wee_mf_t    mf;                     // sliding window match finder
+#endif
+    uint32_t    dep, nic;               // search depth, nice length
+    uint32_t    win, min;               // dictionary window, minimum match
+    int         hc;                     // hash chain match finder
+    int         par;                    // parser
+    wee_cod_t   cod;                    // coder of wee_compress(), files
+    uint32_t    mls[2 * WEE_MF_LIST];   // match candidates (len, dist)
+    uint32_t    mln;                    // .. their number
+    struct wee_opt *opt;                // optimal parse nodes
+    uint8_t     *cbuf;                  // memory output; grows as needed
+    size_t      cmax;                   // .. its allocated size
+    uint8_t     *sib, *sob;             // stream decoder input, output
+    size_t      sop, spu;               // .. decoded and pulled output
+    int         shd;                    // .. magic seen
+};
+
+// Allocate a context. Return NULL on failure.
+
+wee_ctx_t *wee_ctx_new(void)
+{
+    wee_ctx_t *c;
+
+    pthread_once(&wee_equ_once, wee_equ_sel);
+    pthread_once(&wee_pcost_once, wee_pcost_init);
+    if ((c = calloc(1, sizeof(wee_ctx_t))) == NULL)
+        return NULL;
+    if ((c->dbf = wee_big_alloc(3 * WEE_BLK)) == NULL ||
+#ifdef WEE_BLOCKSORT
+        (c->srt = wee_big_alloc(2 * WEE_BLK * sizeof(uint32_t))) == NULL ||
+        (c->idx = wee_big_alloc(2 * WEE_BLK * sizeof(uint32_t))) == NULL) {
+#else
+        wee_mf_init(&c->mf, WEE_BLK, WEE_DEPTH, WEE_NICE)) {
+#endif
+        wee_ctx_free(c);
+        return NULL;
     }
+    c->din = c->dbf;
+    c->cod.pro = WEE_PROB;
+    wee_ctx_flim(c, WEE_FLIM, WEE_FLIM6);
+    wee_ctx_level(c, WEE_LEVEL);
 
-    free(din);
-    free(srt);
-    free(idx);
-
-    return osz;
+    return c;
 }
 
-// Decompress "fin" to "fout".
+// Set compression level 1..9 for the following streams.
 
-size_t wee_file_dec(FILE *fin, FILE *fout, int verb)
+int wee_ctx_level(wee_ctx_t *c, int lvl)
 {
-    uint8_t     din[WEE_BUF + 64];      // in buffer
-    aric_rb_t   rbi;                    // range buffer (in)
-    uint8_t     *dou;                   // out buffer
-    uint32_t    dop;                    // output pointer
-    uint32_t    f8x8[0x100][0x100][2];  // for literals
-    uint32_t    fr6l[0x40][2];          // literal run lengths
-    uint32_t    fr6o[0x40][2];          // for offsets
-    uint32_t    fr6s[0x40][2];          // for string lengths
-    size_t      i, isz, osz;            // looper, input size, output size
-    uint32_t    rof, rle, lit;          // string offset, length
-    uint32_t    pof[5];                 // previous offsets
-    int         l, a, b;                // current and previous byte
+    if (lvl < 1 || lvl > 9)
+        return -1;
+#ifdef WEE_BLOCKSORT
+    c->dep = wee_lvl[lvl].scn;
+#else
+    c->dep = wee_lvl[lvl].dep;
+#endif
+    c->win = wee_lvl[lvl].win;
+    c->min = wee_lvl[lvl].min;
+    c->hc = wee_lvl[lvl].hc;
+    c->par = wee_lvl[lvl].par;
+#ifndef WEE_BLOCKSORT
+    c->mf.mls = c->par == WEE_OPTIMAL ? c->mls : NULL;
+#endif
 
-    if (fgetc(fin) != 0x07 ||           // magic "2016"
-        fgetc(fin) != 0xE0) {
-        fprintf(stderr, "Invalid magic.\n");
-        return 0;
-    }
+    return wee_ctx_tune(c, c->dep, wee_lvl[lvl].nic);
+}
 
-    if ((dou = calloc(3 * WEE_BLK, 1)) == NULL) {
-        perror("calloc()");
-        exit(1);
-    }
+// Set search depth and nice match length; zero keeps the current value.
 
+int wee_ctx_tune(wee_ctx_t *c, uint32_t dep, uint32_t nic)
+{
+    if (nic != 0 && nic < 4)
+        return -1;
+    if (dep != 0)
+        c->dep = dep;
+    if (nic != 0)
+        c->nic = nic;
+#ifndef WEE_BLOCKSORT
+    c->mf.dep = c->dep;
+    c->mf.nic = c->nic;
+#endif
 
-    for (i = 0; i < 0x100; i++) {       // init frequencies
-//      f8x8[i] = calloc(1, sizeof(freq8_t));
-        aric_freqinit(f8x8[i], 8);
-    }
-    aric_freqinit(fr6l, 6);
-    aric_freqinit(fr6o, 6);
-    aric_freqinit(fr6s, 6);
+    return 0;
+}
 
+// Set the count coder limits to 2^lit and 2^sym; 0 for none.
 
-    dop = 0;                            // output pointer
-    isz = 2;                            // input size (magic)
-    osz = 0;                            // number of bytes written
-    for (i = 0; i < 5; i++)             // previous offsets
-        pof[i] = 0;
+int wee_ctx_flim(wee_ctx_t *c, int lit, int sym)
+{
+    if (lit < 0 || lit > 30 || sym < 0 || sym > 30)
+        return -1;
+    c->cod.lim[0] = lit;
+    c->cod.lim[1] = sym;
 
-    // read initial chunk
-    memset(din, 0x00, sizeof(din));
-    i = fread(din, 1, sizeof(din), fin);
-    aric_init_rb(&rbi, din, i, 1);      // this gets the "v" param initialized
-    isz += i;
+    return 0;
+}
 
-    lit = wee_dec_len(&rbi, fr6l);      // first literal length
+// Free a context.
 
-    a = 0x00;                           // current and previous bytes
-    b = 0x00;
+void wee_ctx_free(wee_ctx_t *c)
+{
+    if (c == NULL)
+        return;
+    wee_big_free(c->dbf, 3 * WEE_BLK);
+#ifdef WEE_BLOCKSORT
+    wee_big_free(c->srt, 2 * WEE_BLK * sizeof(uint32_t));
+    wee_big_free(c->idx, 2 * WEE_BLK * sizeof(uint32_t));
+#else
+    wee_mf_free(&c->mf);
+#endif
+    free(c->opt);
+    free(c->cbuf);
+    free(c->sib);
+    wee_big_free(c->sob, 3 * WEE_BLK);
+    wee_mod_free(&c->enc.mod);
+    wee_mod_free(&c->dec.mod);
+    free(c);
+}
 
-    while (rbi.ptr < rbi.max) {
+// Initialize encoder state with output range buffer buf[len]. Return
+// nonzero on failure.
 
-        if (lit > 0) {                  // copy literals
+static int wee_enc_init(wee_enc_t *e, const wee_cod_t *cod,
+    uint8_t *buf, size_t len)
+{
+    int i;
 
-            a = aric_dec(&rbi, f8x8[b], 8);
-            aric_addfreq(f8x8[b], 8, a);
-            dou[dop++] = a;
-            b = a;
-            lit--;
+    if (wee_mod_init(&e->mod, cod))     // init models
+        return -1;
+    if (cod->pro)
+        aric_init_rc(&e->rbo, buf, len, 0);
+    else
+        aric_init_rb(&e->rbo, buf, len, 0);
+
+    e->fin = NULL;
+    e->fout = NULL;
+    e->mem = NULL;
+    e->mep = 0;
+    e->mel = 0;
+    e->isz = 0;
+    e->osz = 0;
+    e->dip = 0;
+    e->dil = 0;
+    e->lit = 0;
+    e->done = 0;
+    e->eof = 0;
+    e->rfr = 0;
+#ifdef WEE_STATS
+    memset(&e->st, 0, sizeof(e->st));
+#endif
+    for (i = 0; i < WEE_OFHIST; i++)    // previous offsets
+        e->pof[i] = 0;
+    e->b = 0x00;                        // previous byte
 
-        } else {                        // repeat
+    return 0;
+}
 
-            l = wee_dec_len(&rbi, fr6s);
-            if (l == -1)                // end symbol
-                break;
-            rle = l;
-
-            if (rle > 0) {              // repeat string offset
-                l = wee_dec_len(&rbi, fr6o);
-                if (l <= 0) {           // use history
-                    rof = pof[-l];
-                } else {
-                    rof = l;
-                    if (l > 32) {       // advance history
-                        for (i = WEE_OFHIST - 1; i > 0; i--)
-                            pof[i] = pof[i - 1];
-                        pof[0] = rof;
-                    }
-                }
+// Read up to len bytes of input to buf.
 
-                if (rof > dop) {        // check for overflow
-                    fprintf(stderr, "Illegal offset.\n");
-                    exit(0);
-                }
+static size_t wee_rdin(wee_enc_t *e, uint8_t *buf, size_t len)
+{
+    size_t i;
+    WEE_ST(double t = wee_st_now());
 
-                for (i = 0; i < rle; i++) { // well, copy it !
-                    dou[dop + i] = dou[dop + i - rof];
-                }
-                dop += rle;
-            }
+    if (e->fin != NULL) {
+        i = fread(buf, 1, len, e->fin);
+    } else {
+        i = e->mel - e->mep;
+        if (i > len)
+            i = len;
+        if (buf != &e->mem[e->mep])     // not windowed in place
+            memcpy(buf, &e->mem[e->mep], i);
+        e->mep += i;
+    }
+    e->isz += i;
+    WEE_ST(e->st.tr += wee_st_now() - t);
 
-            // get new literal length
-            lit = wee_dec_len(&rbi, fr6l);
-        }
+    return i;
+}
 
-        if (dop >= 2 * WEE_BLK) {       // can we write out stuff
-            i = dop - WEE_BLK;
-            if (fwrite(dou, 1, i, fout) != i) {
-                perror("error writing");
-                return 0;
-            }
-            dop -= i;                   // make space
-            memmove(dou, &dou[i], dop);
-            osz += i;
-        }
+// Make room in the range buffer; write it out, or grow it for memory
+// output. The count coder may still carry into the last bytes written,
+// so it needs to leave 64 bytes for that.
 
-        if (rbi.ptr > WEE_BUF) {        // move pointer back, read more
-            rbi.max -= rbi.ptr;
-            memmove(din, &din[rbi.ptr], rbi.max);
-            rbi.ptr = 0;
-            i = fread(&din[rbi.max], 1, sizeof(din) - rbi.max, fin);
-            if (i == 0) {
-                fprintf(stderr, "Unexpected end while reading.\n");
-                return 0;
-            }
-            rbi.max += i;
-            isz += i;
+static int wee_wrout(wee_enc_t *e)
+{
+    aric_rb_t *rbo = &e->rbo;
+    size_t i, keep;
+    uint8_t *p;
+
+    if (e->fout == NULL) {              // memory; double the buffer
+        i = 2 * rbo->max;
+        if ((p = realloc(rbo->buf, i)) == NULL) {
+            perror("realloc()");
+            return -1;
         }
+        rbo->buf = p;
+        rbo->max = i;
+        return 0;
     }
 
-    if (fwrite(dou, 1, dop, fout) != dop) {
-        perror("error writing");
+    keep = e->mod.pro ? 0 : 64;
+    if (rbo->ptr <= keep)
         return 0;
+    WEE_ST(double t = wee_st_now());
+    i = rbo->ptr - keep;
+    if (fwrite(rbo->buf, 1, i, e->fout) != i) {
+        perror("error writing");
+        return -1;
+    }
+    e->osz += i;
+    rbo->ptr -= i;
+    memmove(rbo->buf, &rbo->buf[i], rbo->ptr);
+    WEE_ST(e->st.to += wee_st_now() - t);
+
+    return 0;
+}
+
+// Encode a run of n literals.
+
+static int wee_enc_lit(wee_enc_t *e, const uint8_t *lit, size_t n)
+{
+    size_t i;
+    int a;
+
+    for (i = 0; i < n; i++) {
+        a = lit[i];
+        wee_enc_lit8(&e->rbo, &e->mod, a, e->b);
+        e->b = a;
+        if (e->rbo.ptr > e->rbo.max - 64 && wee_wrout(e))
+            return -1;
+    }
+
+    return 0;
+}
+
+#ifdef WEE_BLOCKSORT
+
+// Sort the window after new input.
+
+static int wee_enc_sort(wee_ctx_t *c)
+{
+    uint8_t     *din = c->din;          // input buffer
+    uint32_t    *srt = c->srt;          // sorted positions
+    uint32_t    *idx = c->idx;          // reverse index
+    size_t      i, sle;                 // looper, sorted len
+#ifdef WEE_QSORT
+    uint8_t     **ptr;                  // pointers for qsort()
+#endif
+    WEE_ST(double t = wee_st_now());
+
+    // clear rest; the sort may look past the end
+    memset(&din[c->enc.dil], 0x00, (3 * WEE_BLK) - c->enc.dil);
+
+    sle = 2 * WEE_BLK;                  // sort
+    if (c->enc.dil < sle)
+        sle = c->enc.dil;
+#ifdef WEE_QSORT
+    if ((ptr = malloc(sle * sizeof(uint8_t *))) == NULL) {
+        perror("malloc()");
+        return -1;
+    }
+    for (i = 0; i < sle; i++)
+        ptr[i] = &din[i];
+    qsort(ptr, sle, sizeof(uint8_t *), wee_compar);
+    for (i = 0; i < sle; i++)
+        srt[i] = ptr[i] - din;
+    free(ptr);
+#else
+    sais_sort(din, srt, sle);           // suffix array
+#endif
+
+    for (i = 0; i < sle; i++) {         // index
+        idx[srt[i]] = i;
+    }
+    WEE_ST(c->enc.st.ts += wee_st_now() - t);
+
+    return 0;
+}
+
+#endif
+
+#ifdef WEE_BLOCKSORT
+
+// Add a match candidate to the list of the optimal parser.
+
+static inline void wee_enc_put(wee_ctx_t *c, uint32_t len, uint32_t dlt)
+{
+    if (c->par != WEE_OPTIMAL)
+        return;
+    if (c->mln >= WEE_MF_LIST)
+        c->mln = WEE_MF_LIST - 1;
+    c->mls[2 * c->mln] = len;
+    c->mls[2 * c->mln + 1] = dlt;
+    c->mln++;
+}
+
+#endif
+
+// Find the longest match at dip and its distance *off. Candidates for the
+// optimal parser go to c->mls[c->mln].
+
+static uint32_t wee_enc_find(wee_ctx_t *c, uint32_t dip, uint32_t *off)
+{
+    wee_enc_t   *e = &c->enc;           // encoder state
+    uint8_t     *din = c->din;          // input buffer
+    uint32_t    dil = e->dil;           // input len
+    uint32_t    ble, bof;               // match len, offset
+#ifdef WEE_BLOCKSORT
+    uint32_t    *srt = c->srt;          // sorted positions
+    uint32_t    *idx = c->idx;          // reverse index
+    uint32_t    sle;                    // sorted len
+    uint32_t    x, y, z, j;             // work variables
+#else
+    wee_mf_t    *mf = &c->mf;           // sliding window match finder
+#endif
+
+#ifndef WEE_BLOCKSORT
+    // longest match from the tree; extend past the search limit.
+    // a tail that may still grow is searched but not inserted
+    if (e->eof || dil - dip >= c->nic)
+        ble = wee_mf_find(mf, &din[dip], dil - dip, &bof);
+    else
+        ble = wee_mf_scan(mf, &din[dip], dil - dip, &bof);
+    c->mln = mf->mln;
+    if (ble == c->nic) {
+        ble += wee_equ(&din[dip + ble], &din[dip + ble - bof],
+            dil - dip - ble);
+    }
+#else
+    sle = dil < 2 * WEE_BLK ? dil : 2 * WEE_BLK;
+    x = idx[dip];                       // find the best match
+    ble = 0;
+    bof = 0;
+    c->mln = 0;
+
+    // scan up
+    for (j = 1; j < c->dep && j <= x; j++) {
+        WEE_ST(e->st.pup++);
+        y = srt[x - j];
+        z = dil - dip;                  // later positions only need a bound
+        if (y > dip && z > c->min)
+            z = c->min;
+        z = wee_equ(&din[dip], &din[y], z);
+        if (z < c->min)
+            break;
+        if (y < dip && dip - y <= c->win) {
+            ble = z;
+            bof = dip - y;
+            wee_enc_put(c, ble, bof);
+            break;
+        }
+    }
+
+    // scan down
+    for (j = 1; j < c->dep && x + j < sle; j++) {
+        WEE_ST(e->st.pdn++);
+        y = srt[x + j];
+        z = dil - dip;
+        if (y > dip && z > c->min)
+            z = ble > c->min ? ble : c->min;
+        z = wee_equ(&din[dip], &din[y], z);
+        if (z < c->min || z < ble)
+            break;
+        if (y < dip && dip - y <= c->win) {
+            if (z > ble) {
+                ble = z;
+                bof = dip - y;
+                wee_enc_put(c, ble, bof);
+            }
+            break;
+        }
+    }
+#endif
+    *off = bof;
+
+    return ble;
+}
+
+// Insert positions a .. b-1 inside a match without searching.
+
+static inline void wee_enc_skip(wee_ctx_t *c, uint32_t a, uint32_t b)
+{
+#ifndef WEE_BLOCKSORT
+    for (; a < b; a++)
+        wee_mf_skip(&c->mf, &c->din[a], c->enc.dil - a, c->enc.eof);
+#endif
+}
+
+// Encode the literal run before dip and a match of ble bytes at bof.
+
+static int wee_enc_match(wee_ctx_t *c, uint32_t dip, uint32_t ble,
+    uint32_t bof)
+{
+    wee_enc_t   *e = &c->enc;           // encoder state
+    uint32_t    *pof = e->pof;          // previous offsets
+    int         l;
+#ifdef WEE_STATS
+    wee_stats_t *st = &e->st;           // statistics
+    wee_stm_t   *m = &e->stm;           // .. last mark
+#endif
+
+    // encode literals
+    wee_enc_len(&e->rbo, e->lit, &e->mod, WEE_RUN);
+    WEE_ST(wee_st_add(e, m, &st->tc, &st->bn));
+    if (wee_enc_lit(e, &c->din[dip - e->lit], e->lit))
+        return -1;
+    WEE_ST(wee_st_add(e, m, &st->tl, &st->bl); st->lit += e->lit);
+    e->lit = 0;
+
+    // encode length
+    wee_enc_len(&e->rbo, ble, &e->mod, WEE_LEN);
+    WEE_ST(wee_st_add(e, m, &st->tc, &st->bn));
+
+    if (ble > 0) {                      // encode offset
+        if (bof <= 32) {
+            wee_enc_len(&e->rbo, bof, &e->mod, WEE_OFS);
+        } else {                        // large offsets use a history feature
+            for (l = 0; l < WEE_OFHIST; l++) {
+                if (pof[l] == bof) {
+                    wee_enc_len(&e->rbo, -l, &e->mod, WEE_OFS);
+                    WEE_ST(st->ohi++);
+                    break;
+                }
+            }
+            if (l == WEE_OFHIST) {
+                // not found in previous offsets
+                wee_enc_len(&e->rbo, bof, &e->mod, WEE_OFS);
+                for (l = WEE_OFHIST - 1; l > 0; l--)
+                    pof[l] = pof[l - 1];
+                pof[0] = bof;
+            }
+        }
+        WEE_ST(wee_st_add(e, m, &st->tc, &st->bo));
+        WEE_ST(st->mat++; st->mln += ble);
+    }
+
+    // output range buffer overflow ?
+    if (e->rbo.ptr > e->rbo.max - 64 && wee_wrout(e))
+        return -1;
+
+    return 0;
+}
+
+// Optimal parse: the cheapest way found to reach a window position, with
+// the coder state that matters for prices after getting there.
+
+typedef struct {
+    uint32_t    pr;                     // price from the window start
+    uint32_t    len, off;               // last step; off 0 for a literal
+    uint32_t    nxt;                    // next position on the best path
+    uint32_t    lit;                    // literal run
+    uint32_t    pof[WEE_OFHIST];        // previous offsets
+    int         b;                      // previous literal
+} wee_opn_t;
+
+struct wee_opt {
+    wee_opn_t   nod[WEE_OPTN + 1];      // nodes for window positions
+    uint32_t    ps6[3][0x40];           // 6-bit symbol prices
+    uint32_t    lpr[WEE_OPTN + 1];      // match length prices
+};
+
+// Price of length l (>= 0) from 6-bit symbol prices ps6, see wee_enc_len.
+
+static inline uint32_t wee_opt_len(const uint32_t ps6[0x40], uint32_t l)
+{
+    uint32_t x;
+
+    if (l <= 32)
+        return ps6[l];
+    x = wee_log2(l);
+
+    return ps6[x + 32] + (x - 1) * WEE_PONE;
+}
+
+// Price of offset bof after node o; *hit is set if it is in the history.
+
+static inline uint32_t wee_opt_ofs(const uint32_t ps6[0x40],
+    const wee_opn_t *o, uint32_t bof, int *hit)
+{
+    int l;
+
+    *hit = 1;
+    if (bof <= 32)
+        return ps6[bof];
+    for (l = 0; l < WEE_OFHIST; l++) {
+        if (o->pof[l] == bof)
+            return ps6[l == 0 ? 0 : 32 + l];
+    }
+    *hit = 0;
+
+    return wee_opt_len(ps6, bof);
+}
+
+// Reach node i + l from node i with a match of l bytes at bof for price pr.
+
+static inline void wee_opt_set(wee_opn_t *nod, uint32_t i, uint32_t l,
+    uint32_t bof, int hit, uint32_t pr)
+{
+    wee_opn_t *o = &nod[i + l];
+    int k;
+
+    if (pr >= o->pr)
+        return;
+    o->pr = pr;
+    o->len = l;
+    o->off = bof;
+    o->lit = 0;
+    o->b = nod[i].b;
+    if (hit) {
+        memcpy(o->pof, nod[i].pof, sizeof(o->pof));
+    } else {                            // new offset goes to the history
+        o->pof[0] = bof;
+        for (k = 1; k < WEE_OFHIST; k++)
+            o->pof[k] = nod[i].pof[k - 1];
+    }
+}
+
+// Encode the window up to "end" with an optimal parse. The parse window
+// ends where no candidate reaches past the current position, so that all
+// paths meet there, at a match of "nice" length, which is taken as is, or
+// after WEE_OPTN positions. Literal prices are taken from the models as
+// they are at the start of each parse window, symbol prices are refreshed
+// every WEE_OPTR positions. Each position is searched once, in order, so
+// the match finder sees the same sequence as with greedy parsing.
+
+static int wee_enc_opt(wee_ctx_t *c, uint32_t end)
+{
+    wee_enc_t   *e = &c->enc;           // encoder state
+    wee_mod_t   *m = &e->mod;           // models
+    uint8_t     *din = c->din;          // input buffer
+    struct wee_opt *opt;                // parser state
+    wee_opn_t   *nod, *o;               // parse nodes
+    uint32_t    dip, n, i, j, l, p;     // window start and len, positions
+    uint32_t    ble, bof, lng, lof;     // match; the long one ending it
+    uint32_t    far, lim, lo;           // furthest node reached, limits
+    uint32_t    pr, pb, po;             // prices
+    int         hit, k;
+#ifdef WEE_STATS
+    wee_stats_t *st = &e->st;           // statistics
+#endif
+
+    if (c->opt == NULL && (c->opt = malloc(sizeof(struct wee_opt))) == NULL) {
+        perror("malloc()");
+        return -1;
+    }
+    opt = c->opt;
+    nod = opt->nod;
+
+    while (e->dip < end) {
+
+        WEE_ST(wee_st_mark(e, &e->stm));
+        dip = e->dip;
+        n = end - dip < WEE_OPTN ? end - dip : WEE_OPTN;
+
+        if (e->rfr == 0) {              // symbol and length prices
+            for (k = 0; k < 3; k++) {
+                for (j = 0; j < 0x40; j++) {
+                    opt->ps6[k][j] = wee_price(m->pro, m->pr6[k],
+                        m->fr6[k], j, 6);
+                }
+            }
+            lim = c->nic < WEE_OPTN ? c->nic : WEE_OPTN;
+            for (l = 0; l <= lim; l++)
+                opt->lpr[l] = wee_opt_len(opt->ps6[WEE_LEN], l);
+            e->rfr = WEE_OPTR;
+        }
+
+        o = &nod[0];
+        o->pr = 0;
+        o->lit = e->lit;
+        memcpy(o->pof, e->pof, sizeof(o->pof));
+        o->b = e->lit > 0 ? din[dip - 1] : e->b;
+
+        far = 0;
+        lng = 0;
+        lof = 0;
+        for (i = 0; i < n; i++) {
+            if (i > 0 && i == far) {    // all paths go through here
+                n = i;
+                break;
+            }
+            p = dip + i;
+            o = &nod[i];
+            ble = wee_enc_find(c, p, &bof);
+            WEE_ST(st->pos++);
+            if (ble >= c->nic) {        // long enough; stop here
+                lng = ble;
+                lof = bof;
+                n = i;
+                break;
+            }
+            lim = n - i < c->nic ? n - i : c->nic;
+            for (j = far + 1; j <= i + lim; j++)
+                nod[j].pr = UINT32_MAX;
+
+            // a literal
+            pr = o->pr + wee_lit_price(m, din[p], o->b);
+            if (pr < nod[i + 1].pr) {
+                nod[i + 1] = *o;
+                nod[i + 1].pr = pr;
+                nod[i + 1].len = 1;
+                nod[i + 1].off = 0;
+                nod[i + 1].lit = o->lit + 1;
+                nod[i + 1].b = din[p];
+            }
+            if (far < i + 1)
+                far = i + 1;
+
+            // ending the literal run here, then a match
+            pb = o->pr + wee_opt_len(opt->ps6[WEE_RUN], o->lit);
+
+            // repeat offsets from the history
+            for (k = 0; k < WEE_OFHIST; k++) {
+                bof = o->pof[k];
+                if (bof == 0 || bof > p || din[p] != din[p - bof])
+                    continue;
+                l = wee_equ(&din[p], &din[p - bof], lim);
+                po = pb + opt->ps6[WEE_OFS][k == 0 ? 0 : 32 + k];
+                for (j = 2; j <= l; j++)
+                    wee_opt_set(nod, i, j, bof, 1, po + opt->lpr[j]);
+                if (l >= 2 && far < i + l)
+                    far = i + l;
+            }
+
+            // match finder candidates, in order of length
+            lo = c->min;
+            for (k = 0; k < c->mln && lo <= lim; k++) {
+                l = c->mls[2 * k];
+                bof = c->mls[2 * k + 1];
+                if (l > lim)
+                    l = lim;
+                po = pb + wee_opt_ofs(opt->ps6[WEE_OFS], o, bof, &hit);
+                for (j = lo; j <= l; j++)
+                    wee_opt_set(nod, i, j, bof, hit, po + opt->lpr[j]);
+                if (l + 1 > lo)
+                    lo = l + 1;
+                if (l >= c->min && far < i + l)
+                    far = i + l;
+            }
+        }
+        WEE_ST(wee_st_add(e, &e->stm, &st->tm, NULL));
+
+        // link the best path forwards and encode it
+        for (i = n; i > 0; i = j) {
+            j = i - nod[i].len;
+            nod[j].nxt = i;
+        }
+        for (i = 0; i < n; i = j) {
+            j = nod[i].nxt;
+            if (nod[j].off == 0) {
+                e->lit++;
+            } else if (wee_enc_match(c, dip + i, j - i, nod[j].off)) {
+                return -1;
+            }
+        }
+
+        if (lng > 0) {                  // the long match that ended it
+            if (wee_enc_match(c, dip + n, lng, lof))
+                return -1;
+            wee_enc_skip(c, dip + n + 1, dip + n + lng);
+            n += lng;
+            WEE_ST(wee_st_add(e, &e->stm, &st->tm, NULL));
+        }
+        e->rfr = e->rfr > n ? e->rfr - n : 0;
+        e->dip = dip + n;
+    }
+
+    return 0;
+}
+
+// Encode the window up to position "end"; greedy or lazy parsing.
+
+static int wee_enc_step(wee_ctx_t *c, uint32_t end)
+{
+    wee_enc_t   *e = &c->enc;           // encoder state
+    uint32_t    dip;                    // input pointer
+    uint32_t    ble, bof;               // match len, offset
+    uint32_t    nle, nof;               // .. at the next position
+    uint32_t    nxt;                    // next position searched already
+#ifdef WEE_STATS
+    wee_stats_t *st = &e->st;           // statistics
+#endif
+
+    if (c->par == WEE_OPTIMAL)
+        return wee_enc_opt(c, end);
+
+    dip = e->dip;
+    nle = 0;
+    nof = 0;
+    nxt = 0;
+
+    while (dip < end) {
+
+        WEE_ST(wee_st_mark(e, &e->stm));
+        if (nxt) {                      // from the lazy look ahead
+            ble = nle;
+            bof = nof;
+            nxt = 0;
+        } else {
+            ble = wee_enc_find(c, dip, &bof);
+            WEE_ST(st->pos++);
+        }
+
+        // lazy: emit a literal instead if the next match is better
+        if (c->par == WEE_LAZY && ble >= c->min && ble < c->nic &&
+            dip + 1 < end) {
+            nle = wee_enc_find(c, dip + 1, &nof);
+            WEE_ST(st->pos++);
+            nxt = 1;
+            if (nle > ble + 1)
+                ble = 0;
+        }
+        WEE_ST(wee_st_add(e, &e->stm, &st->tm, NULL));
+
+        if (ble < c->min) {             // just proceed
+
+            dip++;
+            e->lit++;
+
+        } else {                        // repeat string found
+
+            if (wee_enc_match(c, dip, ble, bof))
+                return -1;
+            wee_enc_skip(c, dip + 1 + nxt, dip + ble);
+            WEE_ST(wee_st_add(e, &e->stm, &st->tm, NULL));
+            nxt = 0;
+            dip += ble;                 // advance pointer
+        }
+    }
+    e->dip = dip;
+
+    return 0;
+}
+
+// Move the window back once it has been encoded past 2 * WEE_BLK.
+
+static int wee_enc_slide(wee_ctx_t *c)
+{
+    wee_enc_t   *e = &c->enc;           // encoder state
+    size_t      i;
+
+    // literal run would fall off the window; end it with a null match
+    if (e->dip > WEE_BLK && e->lit > WEE_BLK) {
+        wee_enc_len(&e->rbo, e->lit, &e->mod, WEE_RUN);
+        if (wee_enc_lit(e, &c->din[e->dip - e->lit], e->lit))
+            return -1;
+        e->lit = 0;
+        wee_enc_len(&e->rbo, 0, &e->mod, WEE_LEN);
+    }
+
+    if (e->dip > WEE_BLK) {             // move data back
+        i = e->dip - WEE_BLK;
+        e->dip -= i;
+        e->dil -= i;
+        if (c->din != c->dbf)           // or the window along the input
+            c->din += i;
+        else
+            memmove(c->din, &c->din[i], e->dil);
+    }
+
+    return 0;
+}
+
+// Encode the pending literal run and symbol -1 (end) or -2 (sync flush),
+// then flush the coder.
+
+static int wee_enc_term(wee_ctx_t *c, int sym)
+{
+    wee_enc_t   *e = &c->enc;           // encoder state
+#ifdef WEE_STATS
+    wee_stm_t   m;
+
+    wee_st_mark(e, &m);
+#endif
+
+    wee_enc_len(&e->rbo, e->lit, &e->mod, WEE_RUN); // remaining literals
+    WEE_ST(wee_st_add(e, &m, &e->st.tc, &e->st.bn));
+    if (wee_enc_lit(e, &c->din[e->dip - e->lit], e->lit))
+        return -1;
+    WEE_ST(wee_st_add(e, &m, &e->st.tl, &e->st.bl); e->st.lit += e->lit);
+    e->lit = 0;
+    wee_enc_len(&e->rbo, sym, &e->mod, WEE_LEN);
+    WEE_ST(wee_st_add(e, &m, &e->st.tc, &e->st.bn));
+    if (e->rbo.ptr > e->rbo.max - 64 && wee_wrout(e))
+        return -1;
+    if (e->mod.pro)                     // flush out buffer
+        aric_final_rc(&e->rbo);
+    else
+        aric_final_out(&e->rbo);
+
+    return 0;
+}
+
+// Compress all input of c->enc; the finalized tail is left in its rbo.
+
+static int wee_enc_data(wee_ctx_t *c)
+{
+    wee_enc_t   *e = &c->enc;           // encoder state
+    int         ret;
+
+#ifndef WEE_BLOCKSORT
+    wee_mf_reset(&c->mf, c->win, c->hc); // forget the previous input
+
+    // input in memory is windowed in place rather than copied; the
+    // window is only read, and never past dil
+    if (e->fin == NULL && e->mem != NULL)
+        c->din = (uint8_t *) e->mem;
+#endif
+
+    while (e->dip <= e->dil) {
+
+        // read as much as possible
+        e->dil += wee_rdin(e, &c->din[e->dil], (3 * WEE_BLK) - e->dil);
+        e->eof = e->dil < 3 * WEE_BLK;  // short read
+
+        if (e->dip >= e->dil)
+            break;
+
+#ifdef WEE_BLOCKSORT
+        if (wee_enc_sort(c))
+            return -1;
+#endif
+        if (wee_enc_step(c, e->dil < 2 * WEE_BLK ? e->dil : 2 * WEE_BLK) ||
+            wee_enc_slide(c)) {
+            c->din = c->dbf;
+            return -1;
+        }
+    }
+    ret = wee_enc_term(c, -1);          // unique end symbol; -1
+    c->din = c->dbf;
+
+    return ret;
+}
+
+// Compress "fin" to "fout".
+
+size_t wee_file_enc(FILE *fin, FILE *fout, int lvl, int verb)
+{
+    uint8_t     dou[WEE_BUF + 2 * 64];  // note: 64B surety at the end
+    wee_ctx_t   *c;                     // context
+    wee_enc_t   *e;                     // encoder state
+    const uint8_t *map;                 // mapped input, or NULL
+    size_t      osz, len, hln;
+
+    if ((c = wee_ctx_new()) == NULL) {
+        perror("calloc()");
+        exit(1);                        // no point continuing
+    }
+    if (wee_ctx_level(c, lvl)) {
+        fprintf(stderr, "Invalid compression level %d.\n", lvl);
+        wee_ctx_free(c);
+        return WEE_ERROR;
+    }
+    e = &c->enc;
+
+    dou[0] = 0x07;                      // magic "2016"
+    hln = 1 + wee_cod_put(&dou[1], &c->cod, 1);
+    if (fwrite(dou, 1, hln, fout) != hln) {
+        perror("error writing");
+        wee_ctx_free(c);
+        return WEE_ERROR;
+    }
+
+    if (wee_enc_init(e, &c->cod, dou, sizeof(dou))) {
+        wee_ctx_free(c);
+        return WEE_ERROR;
+    }
+    if ((map = wee_map_in(fin, &len)) != NULL) {
+        e->mem = map;                   // regular file; no copies
+        e->mel = len;
+    } else {
+        e->fin = fin;
+    }
+    e->fout = fout;
+    e->osz = hln;                       // bytes written (magic)
+
+    osz = WEE_ERROR;
+    if (wee_enc_data(c) == 0) {
+        if (fwrite(dou, 1, e->rbo.ptr, fout) != e->rbo.ptr || fflush(fout)) {
+            perror("error writing");
+        } else {
+            osz = e->osz + e->rbo.ptr;
+            WEE_ST(if (verb) wee_st_print(&e->st, stderr));
+            if (verb) {                 // verbose statistics
+                printf("%12zu %12zu  %.1f%%  ", e->isz, osz,
+                    100.0 * ((double) e->isz - osz) / ((double) e->isz));
+            }
+        }
+    }
+    wee_map_free(map, len);
+    wee_ctx_free(c);
+
+    return osz;
+}
+
+// Compress src[len] into the memory buffer of c.
+
+static int wee_ctx_enc(wee_ctx_t *c, const wee_cod_t *cod,
+    const void *src, size_t len)
+{
+    int ret;
+
+    if (c->cbuf == NULL) {
+        c->cmax = WEE_BUF + 2 * 64;
+        if ((c->cbuf = malloc(c->cmax)) == NULL) {
+            perror("malloc()");
+            return -1;
+        }
+    }
+    if (wee_enc_init(&c->enc, cod, c->cbuf, c->cmax))
+        return -1;
+    c->enc.mem = src;
+    c->enc.mel = len;
+
+    ret = wee_enc_data(c);
+    c->cbuf = c->enc.rbo.buf;           // may have been grown
+    c->cmax = c->enc.rbo.max;
+
+    return ret;
+}
+
+// Compress src[len] to dst[cap].
+
+size_t wee_compress(wee_ctx_t *c, void *dst, size_t cap,
+    const void *src, size_t len)
+{
+    uint8_t *p = dst, h[4];
+    size_t n, hln;
+
+    if (wee_ctx_enc(c, &c->cod, src, len))
+        return WEE_ERROR;
+    n = c->enc.rbo.ptr;
+    h[0] = 0x07;                        // magic "2016"
+    hln = 1 + wee_cod_put(&h[1], &c->cod, 1);
+    if (n + hln > cap)                  // doesn't fit
+        return WEE_ERROR;
+    memcpy(p, h, hln);
+    memcpy(&p[hln], c->cbuf, n);
+
+    return n + hln;
+}
+
+// Streaming compression always uses probabilities (magic 07 E1). Input
+// is encoded as it arrives except for the last "nic" bytes, which are
+// held back for the match search until more input or a flush comes. A
+// sync flush ends the literal run with symbol -2 and flushes the coder,
+// which then restarts on a byte boundary; models carry on.
+
+// Start a compressed stream.
+
+int wee_enc_begin(wee_ctx_t *c)
+{
+    if (c->cbuf == NULL) {
+        c->cmax = WEE_BUF + 2 * 64;
+        if ((c->cbuf = malloc(c->cmax)) == NULL) {
+            perror("malloc()");
+            return -1;
+        }
+    }
+    if (wee_enc_init(&c->enc, &wee_cod_prob, c->cbuf, c->cmax))
+        return -1;
+    c->cbuf[0] = 0x07;                  // magic "2016"
+    c->cbuf[1] = 0xE1;
+    c->enc.rbo.ptr = 2;
+#ifndef WEE_BLOCKSORT
+    wee_mf_reset(&c->mf, c->win, c->hc); // forget the previous input
+#endif
+
+    return 0;
+}
+
+// Compress src[len] into the stream, with an optional flush.
+
+int wee_enc_push(wee_ctx_t *c, const void *src, size_t len, int flush)
+{
+    wee_enc_t   *e = &c->enc;           // encoder state
+    const uint8_t *s = src;             // input
+    uint32_t    end;                    // encode up to here
+    size_t      n;
+    int         ret;
+
+    if (e->done) {
+        fprintf(stderr, "Stream already finished.\n");
+        return -1;
+    }
+
+    ret = -1;
+    for (;;) {
+        n = (3 * WEE_BLK) - e->dil;     // fill the window
+        if (n > len)
+            n = len;
+        if (n > 0)                      // src may be NULL when len is 0
+            memcpy(&c->din[e->dil], s, n);
+        e->dil += n;
+        e->isz += n;
+        s += n;
+        len -= n;
+        e->eof = len == 0 && flush == WEE_FINISH;
+
+        end = e->dil;                   // keep lookahead unless flushing
+        if (len > 0 || flush == WEE_NOFLUSH)
+            end = end > c->nic ? end - c->nic : 0;
+        if (end > 2 * WEE_BLK)
+            end = 2 * WEE_BLK;
+
+        if (e->dip < end) {
+#ifdef WEE_BLOCKSORT
+            if (wee_enc_sort(c))
+                goto done;
+#endif
+            if (wee_enc_step(c, end))
+                goto done;
+        }
+        if (e->dip < 2 * WEE_BLK)       // window not full; need more
+            break;
+        if (wee_enc_slide(c))
+            goto done;
+    }
+
+    if (flush != WEE_NOFLUSH) {
+        if (wee_enc_term(c, flush == WEE_FINISH ? -1 : -2))
+            goto done;
+        if (flush == WEE_FINISH)
+            e->done = 1;
+        else                            // byte aligned; start again
+            aric_restart_rc(&e->rbo, 0);
+    }
+    ret = 0;
+
+done:
+    c->cbuf = e->rbo.buf;               // may have been grown
+    c->cmax = e->rbo.max;
+
+    return ret;
+}
+
+// Get up to cap bytes of compressed output.
+
+size_t wee_enc_pull(wee_ctx_t *c, void *dst, size_t cap)
+{
+    aric_rb_t   *rbo = &c->enc.rbo;     // range buffer (out)
+    size_t      n;
+
+    n = rbo->ptr < cap ? rbo->ptr : cap;
+    memcpy(dst, rbo->buf, n);
+    rbo->ptr -= n;
+    memmove(rbo->buf, &rbo->buf[n], rbo->ptr);
+
+    return n;
+}
+
+// Initialize decoder state with input buf[len]. Return nonzero on
+// failure.
+
+static int wee_dec_init(wee_dec_t *d, const wee_cod_t *cod,
+    uint8_t *buf, size_t len)
+{
+    int i;
+
+    if (wee_mod_init(&d->mod, cod))     // init models
+        return -1;
+    if (cod->pro)                           // gets "v" param initialized
+        aric_init_rc(&d->rbi, buf, len, 1);
+    else
+        aric_init_rb(&d->rbi, buf, len, 1);
+    for (i = 0; i < WEE_OFHIST; i++)    // previous offsets
+        d->pof[i] = 0;
+    d->b = 0x00;                        // previous byte
+    d->end = 0;
+    d->syn = 0;
+    d->lit = wee_dec_len(&d->rbi, &d->mod, WEE_RUN); // first literal length
+
+    return 0;
+}
+
+// Copy a match of rle bytes from rof back to dou[p..], 16 bytes at a
+// time; the last piece overlaps the one before so that nothing past the
+// match is written. Offsets below 16 first repeat the pattern until it is
+// that long; a period of rof is also one of 2 * rof. The overlap may only
+// read from rof bytes before the match on (else byte by byte).
+
+static inline void wee_dec_copy(uint8_t *dou, size_t p, size_t rof,
+    size_t rle)
+{
+    uint8_t *d, *e;
+    size_t n, o;
+
+    o = rof;
+    d = &dou[p];
+    e = &dou[p + rle];
+    while (rof < 16 && d < e) {         // short period
+        n = (size_t) (e - d) < rof ? (size_t) (e - d) : rof;
+        memcpy(d, d - rof, n);
+        d += n;
+        rof += rof;
+    }
+    while (e - d >= 16) {               // well, copy it !
+        memcpy(d, d - rof, 16);
+        d += 16;
+    }
+    if (d < e && rle + o >= rof + 16) { // last piece; ends at e
+        memcpy(e - 16, e - 16 - rof, 16);
+    } else {
+        while (d < e) {
+            *d = d[-rof];
+            d++;
+        }
+    }
+}
+
+// Decode one literal, or a match and the following run length. After a
+// sync flush (-2) the coder restarts before the next run length.
+
+static inline int wee_dec_step(wee_dec_t *d, uint8_t *dou, size_t *dop,
+    size_t dsz)
+{
+    aric_rb_t   *rbi = &d->rbi;         // range buffer (in)
+    size_t      i, p;                   // looper, output pointer
+    uint32_t    rof, rle;               // string offset, length
+    int         l, a;
+
+    p = *dop;
+
+    if (d->lit > 0) {                   // copy literals
+
+        if (p >= dsz) {
+            fprintf(stderr, "Illegal length.\n");
+            return -1;
+        }
+        a = wee_dec_lit8(rbi, &d->mod, d->b);
+        dou[p++] = a;
+        d->b = a;
+        d->lit--;
+
+    } else if (d->syn) {                // coder restarts
+
+        aric_restart_rc(rbi, 1);
+        d->syn = 0;
+        d->lit = wee_dec_len(rbi, &d->mod, WEE_RUN);
+
+    } else {                            // repeat
+
+        l = wee_dec_len(rbi, &d->mod, WEE_LEN);
+        if (l == -1) {                  // end symbol
+            d->end = 1;
+            return 0;
+        }
+        if (l == -2 && d->mod.pro) {    // sync flush
+            d->syn = 1;
+            return 0;
+        }
+        rle = l;
+
+        if (rle > 0) {                  // repeat string offset
+            l = wee_dec_len(rbi, &d->mod, WEE_OFS);
+            if (l <= 0) {               // use history
+                rof = d->pof[-l];
+            } else {
+                rof = l;
+                if (l > 32) {           // advance history
+                    for (i = WEE_OFHIST - 1; i > 0; i--)
+                        d->pof[i] = d->pof[i - 1];
+                    d->pof[0] = rof;
+                }
+            }
+
+            if (rbi->ptr > rbi->max)    // ran out of input
+                return 0;
+            if (rof == 0 || rof > p) {  // unset history or overflow
+                fprintf(stderr, "Illegal offset.\n");
+                return -1;
+            }
+            if (rle > dsz - p) {
+                fprintf(stderr, "Illegal length.\n");
+                return -1;
+            }
+
+            wee_dec_copy(dou, p, rof, rle);
+            p += rle;
+        }
+
+        // get new literal length
+        d->lit = wee_dec_len(rbi, &d->mod, WEE_RUN);
+    }
+    *dop = p;
+
+    return 0;
+}
+
+// Decode to dou[*dop..] until *dop reaches "lim", the input pointer goes
+// past "ilim" or the end symbol is seen. Output is bounded by "dsz".
+
+static int wee_dec_blk(wee_dec_t *d, uint8_t *dou, size_t *dop,
+    size_t lim, size_t dsz, size_t ilim)
+{
+    while (*dop < lim && d->rbi.ptr <= ilim && d->rbi.ptr <= d->rbi.max &&
+        !d->end) {
+        if (wee_dec_step(d, dou, dop, dsz))
+            return -1;
+    }
+
+    return 0;
+}
+
+// Decompress src[len] to dst[cap].
+
+size_t wee_decompress(wee_ctx_t *c, void *dst, size_t cap,
+    const void *src, size_t len)
+{
+    const uint8_t *p = src;
+    wee_cod_t cod;
+    size_t dop, hln;
+    int id;
+
+    id = len < 2 || p[0] != 0x07 ? -1 : wee_cod_mid(p[1]);
+    hln = id == 2 ? 4 : 2;
+    if (id < 0 || len < hln ||
+        wee_cod_set(&cod, id, id == 2 ? &p[2] : NULL)) {
+        fprintf(stderr, "Invalid magic.\n");
+        return WEE_ERROR;
+    }
+    if (wee_dec_init(&c->dec, &cod, (uint8_t *) &p[hln], len - hln))
+        return WEE_ERROR;
+
+    dop = 0;
+    if (wee_dec_blk(&c->dec, dst, &dop, SIZE_MAX, cap, len - hln))
+        return WEE_ERROR;
+    if (!c->dec.end) {
+        fprintf(stderr, "Unexpected end while reading.\n");
+        return WEE_ERROR;
+    }
+
+    return dop;
+}
+
+// Streaming decompression. Input is decoded freely while at least 64
+// bytes of it are left, then one step at a time; a step that runs out of
+// input is undone and retried when more arrives. Output stays in a window
+// of 3 * WEE_BLK until pulled.
+
+// Start decoding a stream.
+
+int wee_dec_begin(wee_ctx_t *c)
+{
+    wee_dec_t   *d = &c->dec;           // decoder state
+    int         i;
+
+    if (c->sib == NULL)
+        c->sib = malloc(WEE_BUF + 64);
+    if (c->sob == NULL)
+        c->sob = wee_big_alloc(3 * WEE_BLK);
+    if (c->sib == NULL || c->sob == NULL) {
+        perror("malloc()");
+        return -1;
+    }
+
+    if (wee_mod_init(&d->mod, &wee_cod_prob)) // init models
+        return -1;
+    aric_init_rc(&d->rbi, c->sib, 0, 0);    // no input yet
+    for (i = 0; i < WEE_OFHIST; i++)    // previous offsets
+        d->pof[i] = 0;
+    d->lit = 0;
+    d->b = 0x00;
+    d->end = 0;
+    d->syn = 1;                         // coder starts with the first step
+    c->sop = 0;
+    c->spu = 0;
+    c->shd = 0;
+
+    return 0;
+}
+
+// Decode buffered stream input as far as it is known to be complete.
+
+static int wee_dec_run(wee_ctx_t *c)
+{
+    wee_dec_t   *d = &c->dec;           // decoder state
+    aric_rb_t   *rbi = &d->rbi;         // range buffer (in)
+    aric_rb_t   rbs;                    // saved state for undo
+    uint32_t    pof[WEE_OFHIST], lit;
+    int         b, syn;
+    size_t      i, sop;
+    uint16_t    p8[WEE_PLIT], p6[3][0x40];
+
+    for (;;) {
+        if (c->sop >= 2 * WEE_BLK) {    // move data back once pulled
+            i = c->sop - WEE_BLK;
+            if (c->spu < i)
+                return 0;
+            memmove(c->sob, &c->sob[i], c->sop - i);
+            c->sop -= i;
+            c->spu -= i;
+        }
+        if (d->end)
+            return 0;
+
+        if (rbi->max >= 64 && wee_dec_blk(d, c->sob, &c->sop,
+            2 * WEE_BLK, 3 * WEE_BLK, rbi->max - 64))
+            return -1;
+
+        while (!d->end && c->sop < 2 * WEE_BLK) {
+
+            rbs = *rbi;                 // save
+            memcpy(pof, d->pof, sizeof(pof));
+            lit = d->lit;
+            b = d->b;
+            syn = d->syn;
+            sop = c->sop;
+            memcpy(p8, d->mod.p8x8[b], sizeof(p8));
+            memcpy(p6, d->mod.pr6, sizeof(p6));
+
+            if (wee_dec_step(d, c->sob, &c->sop, 3 * WEE_BLK))
+                return -1;
+
+            if (rbi->ptr > rbi->max) {  // ran out of input; undo
+                *rbi = rbs;
+                memcpy(d->pof, pof, sizeof(pof));
+                d->lit = lit;
+                d->b = b;
+                d->end = 0;
+                d->syn = syn;
+                c->sop = sop;
+                memcpy(d->mod.p8x8[b], p8, sizeof(p8));
+                memcpy(d->mod.pr6, p6, sizeof(p6));
+                return 0;
+            }
+        }
+    }
+}
+
+// Feed compressed input. Return the number of bytes taken, which is less
+// than len if output must be pulled first, or WEE_ERROR.
+
+size_t wee_dec_push(wee_ctx_t *c, const void *src, size_t len)
+{
+    aric_rb_t   *rbi = &c->dec.rbi;     // range buffer (in)
+    const uint8_t *s = src;             // input
+    size_t      n, used;
+
+    used = 0;
+    do {
+        if (rbi->ptr > 0) {             // move unread input back
+            rbi->max -= rbi->ptr;
+            memmove(c->sib, &c->sib[rbi->ptr], rbi->max);
+            rbi->ptr = 0;
+        }
+        n = WEE_BUF + 64 - rbi->max;
+        if (n > len - used)
+            n = len - used;
+        memcpy(&c->sib[rbi->max], &s[used], n);
+        rbi->max += n;
+        used += n;
+
+        if (!c->shd) {                  // magic "2016"
+            if (rbi->max < 2)
+                continue;
+            if (c->sib[0] != 0x07 || c->sib[1] != 0xE1) {
+                fprintf(stderr, "Invalid magic.\n");
+                return WEE_ERROR;
+            }
+            rbi->ptr = 2;
+            c->shd = 1;
+        }
+        if (wee_dec_run(c))
+            return WEE_ERROR;
+    } while (n > 0 && !c->dec.end);
+
+    return used;
+}
+
+// Get up to cap bytes of decompressed output, or WEE_ERROR.
+
+size_t wee_dec_pull(wee_ctx_t *c, void *dst, size_t cap)
+{
+    size_t n;
+
+    n = c->sop - c->spu;
+    if (n > cap)
+        n = cap;
+    memcpy(dst, &c->sob[c->spu], n);
+    c->spu += n;
+
+    if (c->sop >= 2 * WEE_BLK && wee_dec_run(c))   // window was full
+        return WEE_ERROR;
+
+    return n;
+}
+
+// Has the end of the stream been reached and all of it pulled?
+
+int wee_dec_end(wee_ctx_t *c)
+{
+    return c->dec.end && c->spu == c->sop;
+}
+
+static size_t wee_file_dec_frm(FILE *fin, FILE *fout, int nthr, int verb);
+
+// The file decoder writes out its buffer when it is full, keeping the last
+// WEE_BLK bytes as the window; a larger buffer means fewer moves and
+// writes. Input is read in chunks of WEE_DIN bytes.
+
+#ifndef WEE_DOU
+#define WEE_DOU (8 * WEE_BLK)
+#endif
+#ifndef WEE_DIN
+#define WEE_DIN 0x40000
+#endif
+
+// Decompress "fin" to "fout"; frames are decoded with "nthr" threads.
+
+size_t wee_file_dec_mt(FILE *fin, FILE *fout, int nthr, int verb)
+{
+    uint8_t     *din;                   // in buffer
+    uint8_t     *dou;                   // out buffer
+    size_t      dop;                    // output pointer
+    wee_dec_t   *d;                     // decoder state
+    size_t      i, isz, osz;            // looper, input size, output size
+    wee_cod_t   cod;                    // coder
+    int         l;
+
+    if (fgetc(fin) != 0x07 || (l = fgetc(fin)) < 0) {   // magic "2016"
+        fprintf(stderr, "Invalid magic.\n");
+        return WEE_ERROR;
+    }
+    if (l == 0xE2)                      // independent frames
+        return wee_file_dec_frm(fin, fout, nthr, verb);
+    if ((l = wee_cod_mid(l)) < 0 || wee_cod_rd(fin, l, &cod)) {
+        fprintf(stderr, "Invalid magic.\n");
+        return WEE_ERROR;
+    }
+
+    if ((din = wee_big_alloc(WEE_DIN + 64)) == NULL ||
+        (dou = wee_big_alloc(WEE_DOU)) == NULL ||
+        (d = calloc(1, sizeof(wee_dec_t))) == NULL) {
+        perror("mmap()");
+        exit(1);
+    }
+
+    dop = 0;                            // output pointer
+    isz = l == 2 ? 4 : 2;               // input size (magic)
+    osz = 0;                            // number of bytes written
+
+    // read initial chunk
+    i = fread(din, 1, WEE_DIN + 64, fin);
+    isz += i;
+    if (wee_dec_init(d, &cod, din, i))
+        goto fail;
+
+    while (!d->end) {
+
+        if (wee_dec_blk(d, dou, &dop, WEE_DOU - WEE_BLK, WEE_DOU, WEE_DIN))
+            goto fail;
+        if (d->rbi.ptr > d->rbi.max)    // past max on read error
+            break;
+
+        if (dop >= WEE_DOU - WEE_BLK) { // write out all but the window
+            i = dop - WEE_BLK;
+            if (fwrite(dou, 1, i, fout) != i) {
+                perror("error writing");
+                goto fail;
+            }
+            dop -= i;                   // make space
+            memmove(dou, &dou[i], dop);
+            osz += i;
+        }
+
+        if (d->rbi.ptr > WEE_DIN) {     // move pointer back, read more
+            d->rbi.max -= d->rbi.ptr;
+            memmove(din, &din[d->rbi.ptr], d->rbi.max);
+            d->rbi.ptr = 0;
+            i = fread(&din[d->rbi.max], 1, WEE_DIN + 64 - d->rbi.max, fin);
+            d->rbi.max += i;
+            isz += i;
+        }
+    }
+
+    if (!d->end) {
+        fprintf(stderr, "Unexpected end while reading.\n");
+        goto fail;
+    }
+
+    if (fwrite(dou, 1, dop, fout) != dop) {
+        perror("error writing");
+        goto fail;
     }
     osz += dop;
+    wee_mod_free(&d->mod);
+    free(d);
+    wee_big_free(dou, WEE_DOU);
+    wee_big_free(din, WEE_DIN + 64);
+
+    if (verb) {
+        printf("%12zu %12zu  %.1f%%  ",
+            isz, osz, 100.0 * ((double) osz - isz) / ((double) osz));
+    }
+
+    return osz;
+
+fail:
+    wee_mod_free(&d->mod);
+    free(d);
+    wee_big_free(dou, WEE_DOU);
+    wee_big_free(din, WEE_DIN + 64);
+    return WEE_ERROR;
+}
+
+// Decompress "fin" to "fout".
+
+size_t wee_file_dec(FILE *fin, FILE *fout, int verb)
+{
+    return wee_file_dec_mt(fin, fout, 0, verb);
+}
+
+// Framed format (magic 07 E2): a coder byte (0 counts, 1 probabilities,
+// 2 limited counts followed by the two limits; see wee_cod_t) and log2 of
+// the maximum frame size, then frames of "u32 usize, u32 csize"
+// (little-endian) followed by csize bytes. Each frame is an independent
+// stream with fresh models and its own end symbol. usize 0 ends the file.
+//
+// A seek table may follow the end marker: "u32 usize, u32 csize" for each
+// frame, the u32 number of frames and the 4-byte trailer 07 E2 'S' 'T'.
+// Sequential readers stop at the end marker and never see it.
+
+#ifndef WEE_FRM
+#define WEE_FRM (8 * WEE_BLK)
+#endif
+
+static const uint8_t wee_skt_mag[4] = { 0x07, 0xE2, 'S', 'T' };
+
+// A frame; compressed or decompressed on its own by a worker.
+
+typedef struct {
+    wee_job_t   job;                    // worker pool job
+    wee_ctx_t   **ctx;                  // encoder contexts, one per worker
+    wee_cod_t   cod;                    // coder
+    int         lvl;                    // level
+    uint8_t     *raw, *cmp;             // uncompressed, compressed data
+    size_t      usz, csz;               // .. and their sizes
+    size_t      cmx;                    // allocated size of cmp
+    int         err;                    // nonzero on failure
+} wee_frm_t;
+
+// Little-endian 32-bit words for the frame headers.
+
+static int wee_put32(FILE *f, uint32_t x)
+{
+    uint8_t b[4];
+
+    b[0] = x;
+    b[1] = x >> 8;
+    b[2] = x >> 16;
+    b[3] = x >> 24;
+
+    return fwrite(b, 1, 4, f) != 4;
+}
+
+static int wee_get32(FILE *f, uint32_t *x)
+{
+    uint8_t b[4];
+
+    if (fread(b, 1, 4, f) != 4)
+        return -1;
+    *x = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t) b[3] << 24);
+
+    return 0;
+}
+
+// Compress frame f->raw to f->cmp, which is grown as needed. The context
+// of the worker is made on its first frame and reset for each one after.
+
+static void wee_frm_enc(void *arg)
+{
+    wee_frm_t *f = arg;
+    wee_ctx_t *c;
+
+    if ((c = f->ctx[f->job.wid]) == NULL &&
+        (c = f->ctx[f->job.wid] = wee_ctx_new()) == NULL) {
+        perror("calloc()");
+        exit(1);
+    }
+    c->cbuf = f->cmp;                   // lend the buffer of the frame
+    c->cmax = f->cmx;
+    f->err = wee_ctx_level(c, f->lvl) ||
+        wee_ctx_enc(c, &f->cod, f->raw, f->usz);
+    f->cmp = c->cbuf;                   // .. and take it back
+    f->csz = c->enc.rbo.ptr;
+    f->cmx = c->cmax;
+    c->cbuf = NULL;
+}
+
+// Decompress frame f->cmp to f->raw.
+
+static void wee_frm_dec(void *arg)
+{
+    wee_frm_t *f = arg;
+    wee_dec_t *d;
+    size_t dop;
+
+    if ((d = calloc(1, sizeof(wee_dec_t))) == NULL) {
+        perror("calloc()");
+        exit(1);
+    }
+
+    dop = 0;                            // must end exactly at usz
+    f->err = wee_dec_init(d, &f->cod, f->cmp, f->csz) ||
+        wee_dec_blk(d, f->raw, &dop, f->usz + 1, f->usz, f->csz) ||
+        !d->end || dop != f->usz;
+    wee_mod_free(&d->mod);
+    free(d);
+}
+
+// Write out a compressed frame.
+
+static int wee_frm_wr(FILE *fout, const wee_frm_t *f)
+{
+    if (wee_put32(fout, f->usz) || wee_put32(fout, f->csz) ||
+        fwrite(f->cmp, 1, f->csz, fout) != f->csz) {
+        perror("error writing");
+        return -1;
+    }
+
+    return 0;
+}
+
+// Read in a compressed frame of at most fsz bytes uncompressed.
+// Return 1 at the end marker, -1 on error.
+
+static int wee_frm_rd(FILE *fin, wee_frm_t *f, size_t fsz)
+{
+    uint32_t usz, csz;
+    uint8_t *p;
+
+    if (wee_get32(fin, &usz)) {
+        fprintf(stderr, "Unexpected end while reading.\n");
+        return -1;
+    }
+    if (usz == 0)                       // end marker
+        return 1;
+    if (wee_get32(fin, &csz) || usz > fsz || csz > 2 * fsz + WEE_BUF) {
+        fprintf(stderr, "Invalid frame.\n");
+        return -1;
+    }
+
+    if (csz > f->cmx) {                 // make room
+        if ((p = realloc(f->cmp, csz)) == NULL) {
+            perror("realloc()");
+            exit(1);
+        }
+        f->cmp = p;
+        f->cmx = csz;
+    }
+    if (fread(f->cmp, 1, csz, fin) != csz) {
+        fprintf(stderr, "Unexpected end while reading.\n");
+        return -1;
+    }
+    f->usz = usz;
+    f->csz = csz;
+
+    return 0;
+}
+
+// Compress "fin" to "fout" as independent frames with "nthr" threads.
+
+size_t wee_file_enc_mt(FILE *fin, FILE *fout, int nthr, int lvl, int verb)
+{
+    wee_pool_t  pool;                   // worker threads
+    wee_frm_t   *frm, *f;               // ring of frames in flight
+    size_t      nfr, rd, wr;            // ring size, frames read, written
+    size_t      i, isz, osz;            // looper, input and output size
+    wee_ctx_t   **ctx;                  // encoder context of each worker
+    uint32_t    (*skt)[2];              // seek table
+    const uint8_t *map;                 // mapped input, or NULL
+    size_t      mop, len;               // .. its frame pointer and length
+    wee_cod_t   cod;                    // coder
+    uint8_t     hdr[6];                 // header
+    size_t      hln;                    // .. its length
+    int         eof, err;
+
+    if (nthr < 1)
+        nthr = 1;
+    nfr = 2 * nthr;                     // keep workers busy while writing
+    skt = NULL;
+    if ((frm = calloc(nfr, sizeof(wee_frm_t))) == NULL ||
+        (ctx = calloc(nthr, sizeof(wee_ctx_t *))) == NULL) {
+        perror("calloc()");
+        exit(1);
+    }
+    map = wee_map_in(fin, &len);        // frames point into it
+    mop = 0;
+    for (i = 0; i < nfr && map == NULL; i++) {
+        if ((frm[i].raw = malloc(WEE_FRM)) == NULL) {
+            perror("malloc()");
+            exit(1);
+        }
+    }
+    if (wee_pool_init(&pool, nthr)) {
+        fprintf(stderr, "Can't start threads.\n");
+        exit(1);
+    }
+
+    cod.pro = WEE_PROB;
+    cod.lim[0] = WEE_FLIM;
+    cod.lim[1] = WEE_FLIM6;
+    hdr[0] = 0x07;                      // magic "2016"
+    hdr[1] = 0xE2;
+    hln = 2 + wee_cod_put(&hdr[2], &cod, 0);   // coder
+    hdr[hln++] = wee_log2(WEE_FRM - 1); // maximum frame size
+    err = fwrite(hdr, 1, hln, fout) != hln;
+
+    isz = 0;
+    osz = hln;
+    rd = 0;
+    wr = 0;
+    eof = 0;
+
+    for (;;) {
+        while (!eof && !err && rd - wr < nfr) {
+            f = &frm[rd % nfr];         // read and queue next frame
+            if (map != NULL) {
+                f->raw = (uint8_t *) &map[mop];
+                f->usz = len - mop < WEE_FRM ? len - mop : WEE_FRM;
+                mop += f->usz;
+            } else {
+                f->usz = fread(f->raw, 1, WEE_FRM, fin);
+            }
+            if (f->usz < WEE_FRM)
+                eof = 1;
+            if (f->usz == 0)
+                break;
+            isz += f->usz;
+            f->ctx = ctx;
+            f->cod = cod;
+            f->lvl = lvl;
+            wee_pool_put(&pool, &f->job, wee_frm_enc, f);
+            rd++;
+        }
+        if (wr == rd)
+            break;
+
+        f = &frm[wr % nfr];             // write out in order
+        wee_pool_wait(&pool, &f->job);
+        if (!err && (f->err || wee_frm_wr(fout, f)))
+            err = 1;
+        if ((skt = realloc(skt, (wr + 1) * sizeof(*skt))) == NULL) {
+            perror("realloc()");
+            exit(1);
+        }
+        skt[wr][0] = f->usz;
+        skt[wr][1] = f->csz;
+        osz += 8 + f->csz;
+        wr++;
+    }
+
+    if (!err && wee_put32(fout, 0)) {   // end marker
+        perror("error writing");
+        err = 1;
+    }
+    osz += 4;
+
+    for (i = 0; i < wr && !err; i++) {  // seek table
+        if (wee_put32(fout, skt[i][0]) || wee_put32(fout, skt[i][1]))
+            err = 1;
+    }
+    if (!err && (wee_put32(fout, wr) ||
+        fwrite(wee_skt_mag, 1, 4, fout) != 4 || fflush(fout)))
+        err = 1;
+    if (err)
+        perror("error writing");
+    osz += 8 * wr + 8;
+
+    wee_pool_free(&pool);
+    for (i = 0; i < (size_t) nthr; i++)
+        wee_ctx_free(ctx[i]);
+    for (i = 0; i < nfr; i++) {
+        free(frm[i].cmp);
+        if (map == NULL)
+            free(frm[i].raw);
+    }
+    if (map != NULL)
+        wee_map_free(map, len);
+    free(frm);
+    free(ctx);
+    free(skt);
+
+    if (err)
+        return WEE_ERROR;
+
+    if (verb) {                         // verbose statistics
+        printf("%12zu %12zu  %.1f%%  ",
+            isz, osz, 100.0 * ((double) isz - osz) / ((double) isz));
+    }
+
+    return osz;
+}
+
+// Decompress frames (after magic) from "fin" to "fout". With "nthr"
+// workers up to 2 * nthr frames are decoded ahead of the writer.
+
+static size_t wee_file_dec_frm(FILE *fin, FILE *fout, int nthr, int verb)
+{
+    wee_pool_t  pool;                   // worker threads
+    wee_frm_t   *frm, *f;               // ring of frames in flight
+    size_t      nfr, rd, wr;            // ring size, frames read, written
+    size_t      i, fsz, isz, osz;       // frame, input and output size
+    wee_cod_t   cod;                    // coder
+    int         l, eof, err;
+
+    if ((l = fgetc(fin)) < 0 || wee_cod_rd(fin, l, &cod) ||
+        (l = fgetc(fin)) < 0 || l > 31) {
+        fprintf(stderr, "Invalid header.\n");
+        return WEE_ERROR;
+    }
+    fsz = (size_t) 1 << l;
+
+    nfr = nthr > 0 ? 2 * nthr : 1;
+    if ((frm = calloc(nfr, sizeof(wee_frm_t))) == NULL) {
+        perror("calloc()");
+        exit(1);
+    }
+    for (i = 0; i < nfr; i++) {
+        frm[i].cod = cod;
+        if ((frm[i].raw = malloc(fsz)) == NULL) {
+            perror("malloc()");
+            exit(1);
+        }
+    }
+    if (nthr > 0 && wee_pool_init(&pool, nthr)) {
+        fprintf(stderr, "Can't start threads.\n");
+        exit(1);
+    }
+
+    isz = wee_cod_id(&cod) == 2 ? 6 : 4;    // header
+    osz = 0;
+    rd = 0;
+    wr = 0;
+    eof = 0;
+    err = 0;
+
+    for (;;) {
+        while (!eof && !err && rd - wr < nfr) {
+            f = &frm[rd % nfr];         // read and queue next frame
+            if ((l = wee_frm_rd(fin, f, fsz)) != 0) {
+                eof = 1;
+                err = l < 0;
+                break;
+            }
+            isz += 8 + f->csz;
+            if (nthr > 0)
+                wee_pool_put(&pool, &f->job, wee_frm_dec, f);
+            else
+                wee_frm_dec(f);
+            rd++;
+        }
+        if (wr == rd)
+            break;
+
+        f = &frm[wr % nfr];             // write out in order
+        if (nthr > 0)
+            wee_pool_wait(&pool, &f->job);
+        if (!err && f->err) {
+            fprintf(stderr, "Corrupt frame.\n");
+            err = 1;
+        }
+        if (!err && fwrite(f->raw, 1, f->usz, fout) != f->usz) {
+            perror("error writing");
+            err = 1;
+        }
+        osz += f->usz;
+        wr++;
+    }
+    isz += 4;
+
+    if (nthr > 0)
+        wee_pool_free(&pool);
+    for (i = 0; i < nfr; i++) {
+        free(frm[i].raw);
+        free(frm[i].cmp);
+    }
+    free(frm);
+
+    if (err)
+        return WEE_ERROR;
 
     if (verb) {
         printf("%12zu %12zu  %.1f%%  ",
@@ -463,3 +2579,156 @@ size_t wee_file_dec(FILE *fin, FILE *fout, int verb)
     return osz;
 }
 
+// Get the frame sizes of a framed file, positioned after its header;
+// from the seek table if there is a valid one, otherwise by walking
+// the frame headers. Return NULL on failure.
+
+static uint32_t (*wee_skt_rd(FILE *fin, uint32_t *nfr))[2]
+{
+    uint32_t    (*skt)[2];              // seek table
+    uint32_t    n, k;
+    uint8_t     mag[4];
+    off_t       hln, end, pos;
+
+    skt = NULL;
+    if ((hln = ftello(fin)) < 0 || fseeko(fin, 0, SEEK_END) ||
+        (end = ftello(fin)) < 0) {
+        perror("can't seek");
+        return NULL;
+    }
+
+    // trailer and table
+    if (end >= 16 && fseeko(fin, end - 8, SEEK_SET) == 0 &&
+        wee_get32(fin, &n) == 0 && fread(mag, 1, 4, fin) == 4 &&
+        memcmp(mag, wee_skt_mag, 4) == 0 &&
+        (off_t) n * 8 + 16 <= end &&
+        fseeko(fin, end - 8 - (off_t) n * 8, SEEK_SET) == 0 &&
+        (skt = calloc(n + 1, sizeof(*skt))) != NULL) {
+
+        pos = hln;                      // header
+        for (k = 0; k < n; k++) {
+            if (wee_get32(fin, &skt[k][0]) || wee_get32(fin, &skt[k][1]))
+                break;
+            pos += 8 + (off_t) skt[k][1];
+        }
+        if (k == n && pos + 4 + (off_t) n * 8 + 8 == end) {
+            *nfr = n;
+            return skt;
+        }
+        free(skt);
+        skt = NULL;
+    }
+
+    // no table; walk the frames
+    if (fseeko(fin, hln, SEEK_SET)) {
+        perror("can't seek");
+        return NULL;
+    }
+    for (n = 0; ; n++) {
+        if ((skt = realloc(skt, (n + 1) * sizeof(*skt))) == NULL) {
+            perror("realloc()");
+            exit(1);
+        }
+        if (wee_get32(fin, &skt[n][0]))
+            break;
+        if (skt[n][0] == 0) {           // end marker
+            *nfr = n;
+            return skt;
+        }
+        if (wee_get32(fin, &skt[n][1]) ||
+            fseeko(fin, skt[n][1], SEEK_CUR))
+            break;
+    }
+    fprintf(stderr, "Unexpected end while reading.\n");
+    free(skt);
+
+    return NULL;
+}
+
+// Decompress "len" bytes at offset "off" of a framed file to "fout",
+// decoding only the frames that cover the range.
+
+int wee_file_ext(FILE *fin, FILE *fout, uint64_t off, uint64_t len,
+    int verb)
+{
+    wee_frm_t   frm;                    // current frame
+    uint32_t    (*skt)[2];              // seek table
+    uint32_t    k, nfr;                 // frame index, number of frames
+    uint64_t    uof, i, n;              // uncompressed offset of frame
+    off_t       cof;                    // compressed offset of frame
+    size_t      isz, osz;               // input and output size
+    int         l, ret;
+
+    if (fgetc(fin) != 0x07 || fgetc(fin) != 0xE2) {
+        fprintf(stderr, "Not a framed file.\n");
+        return -1;
+    }
+    memset(&frm, 0x00, sizeof(frm));
+    if ((l = fgetc(fin)) < 0 || wee_cod_rd(fin, l, &frm.cod) ||
+        (l = fgetc(fin)) < 0 || l > 31) {
+        fprintf(stderr, "Invalid header.\n");
+        return -1;
+    }
+    cof = ftello(fin);                  // first frame
+    if ((skt = wee_skt_rd(fin, &nfr)) == NULL)
+        return -1;
+    for (k = 0, uof = 0; k < nfr; k++)  // uncompressed size
+        uof += skt[k][0];
+    if (off > uof) {
+        fprintf(stderr, "Offset %llu is beyond the end (%llu).\n",
+            (unsigned long long) off, (unsigned long long) uof);
+        free(skt);
+        return -1;
+    }
+
+    if ((frm.raw = malloc((size_t) 1 << l)) == NULL) {
+        perror("malloc()");
+        exit(1);
+    }
+
+    ret = 0;
+    isz = 0;
+    osz = 0;
+    uof = 0;
+    for (k = 0; k < nfr && len > 0; k++) {
+        if (off < uof + skt[k][0]) {    // frame covers the offset
+            if (fseeko(fin, cof, SEEK_SET) ||
+                wee_frm_rd(fin, &frm, (size_t) 1 << l) != 0 ||
+                frm.usz != skt[k][0]) {
+                fprintf(stderr, "Invalid frame.\n");
+                ret = -1;
+                break;
+            }
+            isz += 8 + frm.csz;
+            wee_frm_dec(&frm);
+            if (frm.err) {
+                fprintf(stderr, "Corrupt frame.\n");
+                ret = -1;
+                break;
+            }
+            i = off - uof;              // the covered part
+            n = frm.usz - i;
+            if (n > len)
+                n = len;
+            if (fwrite(&frm.raw[i], 1, n, fout) != n) {
+                perror("error writing");
+                ret = -1;
+                break;
+            }
+            osz += n;
+            off += n;
+            len -= n;
+        }
+        uof += skt[k][0];
+        cof += 8 + (off_t) skt[k][1];
+    }
+
+    free(frm.raw);
+    free(frm.cmp);
+    free(skt);
+
+    if (verb && ret == 0)
+        printf("%12zu %12zu  ", isz, osz);
+
+    return ret;
+}
@@ -0,0 +1,219 @@
+// weei.h
+// 31-Dec-15  Markku-Juhani O. Saarinen <mjos@iki.fi>
+// Internals shared by the library and the wee program: the range coder,
+// suffix sorting, match finder, memory and thread pool. Not installed.
+
+#ifndef WEEI_H
+#define WEEI_H
+
+#include <pthread.h>
+
+#include "wee.h"
+
+// Range buffer structure
+typedef struct {
+    uint8_t *buf;                       // output buffer
+    size_t ptr, max;                    // pointer and maximum size (bytes)
+    int bit;                            // bit index
+    uint32_t byt;                       // partial byte
+    uint32_t b, l, v;                   // range indicators, optional input
+    uint64_t lo;                        // low end with carry (byte coder)
+    size_t pnd;                         // cached + pending bytes (byte coder)
+} aric_rb_t;
+
+// Sliding window match finder
+typedef struct {
+    uint32_t *hsh;                      // hash heads
+    uint32_t *son;                      // tree (two nodes per pos) or chain
+    uint32_t pos, cpo;                  // absolute and cyclic position
+    uint32_t cyc;                       // window (cyclic buffer) size
+    uint32_t wmx;                       // .. allocated size
+    uint32_t dep, nic;                  // search depth, "nice" length
+    int hc;                             // hash chains instead of a tree
+    uint32_t *mls;                      // WEE_MF_LIST (len, dist), or NULL
+    uint32_t mln;                       // .. number of pairs
+} wee_mf_t;
+
+// Capacity of the match list in pairs
+#define WEE_MF_LIST 32
+
+// Job for the worker pool
+typedef struct wee_job {
+    void (*fn)(void *);                 // function to run
+    void *arg;                          // .. its argument
+    int done;                           // completed
+    int wid;                            // worker 0..nthr-1 that ran it
+    struct wee_job *next;               // queue link
+} wee_job_t;
+
+// Worker thread pool
+typedef struct {
+    pthread_t *thr;                     // threads
+    int nthr;                           // number of threads
+    int nid;                            // workers numbered so far
+    pthread_mutex_t mtx;                // protects everything below
+    pthread_cond_t cnd, fin;            // job queued, job completed
+    wee_job_t *head, *tail;             // FIFO job queue
+    int quit;                           // shutting down
+} wee_pool_t;
+
+// == aric.c ==
+
+// Initialize frequencies to "balanced".
+void aric_freqinit(uint32_t freq[][2], size_t bits);
+
+// Divide frequencies in half, "de-emphasizing past".
+void aric_freqhalf(uint32_t freq[][2], size_t bits);
+
+// Update a frequency distribution for "bits"-sized word x.
+void aric_addfreq(uint32_t freq[][2], size_t bits, uint32_t x);
+
+// Update frequencies, halving those of nodes whose total exceeds lim.
+void aric_addfreql(uint32_t freq[][2], size_t bits, uint32_t x, uint32_t lim);
+
+// Initialize a range buffer.
+void aric_init_rb(aric_rb_t *rb, void *buf, size_t len, int dec);
+
+// Encode a "bits"-sized word to output stream.
+int aric_enc(aric_rb_t *rb,             // output range buffer
+    uint32_t iwrd,                      // input word to be encoded
+    uint32_t freq[][2], size_t bits);   // binary frequencies
+
+// Finalize output range buffer.
+size_t aric_final_out(aric_rb_t *rb);
+
+// Decode input word.
+uint32_t aric_dec(aric_rb_t *rb,        // input range buffer
+    uint32_t freq[][2], size_t bits);   // binary frequencies
+
+// Encode / decode a byte or a 6-bit word and update the counts.
+int aric_encf8(aric_rb_t *rb, uint32_t iwrd, uint32_t freq[][2],
+    uint32_t lim);
+uint32_t aric_decf8(aric_rb_t *rb, uint32_t freq[][2], uint32_t lim);
+int aric_encf6(aric_rb_t *rb, uint32_t iwrd, uint32_t freq[][2],
+    uint32_t lim);
+uint32_t aric_decf6(aric_rb_t *rb, uint32_t freq[][2], uint32_t lim);
+
+// Initialize adaptive probabilities to "balanced".
+void aric_probinit(uint16_t prob[], size_t bits);
+
+// Initialize a range buffer for the byte-oriented (probability) coder.
+void aric_init_rc(aric_rb_t *rb, void *buf, size_t len, int dec);
+
+// Finalize output of the byte-oriented coder.
+size_t aric_final_rc(aric_rb_t *rb);
+
+// Restart the byte-oriented coder at the current buffer position.
+void aric_restart_rc(aric_rb_t *rb, int dec);
+
+// Encode a "bits"-sized word with adaptive probabilities; no divisions.
+int aric_encp(aric_rb_t *rb,            // output range buffer
+    uint32_t iwrd,                      // input word to be encoded
+    uint16_t prob[], size_t bits);      // adaptive probabilities
+
+// Decode a word with adaptive probabilities.
+uint32_t aric_decp(aric_rb_t *rb,       // input range buffer
+    uint16_t prob[], size_t bits);      // adaptive probabilities
+
+// Encode / decode a 6-bit word with adaptive probabilities.
+int aric_encp6(aric_rb_t *rb, uint32_t iwrd, uint16_t prob[]);
+uint32_t aric_decp6(aric_rb_t *rb, uint16_t prob[]);
+
+// Encode / decode a byte as two nibbles; prob[] has 17 trees of 16.
+int aric_encp8(aric_rb_t *rb, uint32_t iwrd, uint16_t prob[]);
+uint32_t aric_decp8(aric_rb_t *rb, uint16_t prob[]);
+
+// Encode / decode "bits" equiprobable bits with the byte-oriented coder.
+int aric_encd(aric_rb_t *rb, uint32_t iwrd, size_t bits);
+uint32_t aric_decd(aric_rb_t *rb, size_t bits);
+
+// == sais.c ==
+
+// Construct the suffix array of buf[0..n-1] into sa[0..n-1].
+void sais_sort(const uint8_t *buf, uint32_t *sa, uint32_t n);
+
+// == weemf.c ==
+
+// Initialize a match finder with window "win" and search depth "dep";
+// stop search at "nic" matching bytes. Return nonzero on failure.
+int wee_mf_init(wee_mf_t *mf, uint32_t win, uint32_t dep, uint32_t nic);
+
+// Free match finder tables.
+void wee_mf_free(wee_mf_t *mf);
+
+// Forget all inserted positions (cheaply) before new input; continue with
+// window "win" (at most the initial one), using hash chains if "hc".
+void wee_mf_reset(wee_mf_t *mf, uint32_t win, int hc);
+
+// Insert position at p ("avail" bytes valid). Return longest match length
+// (at most "nic") and store its distance to *off. If mf->mls is set, every
+// improving match on the way goes there too, in order of length.
+uint32_t wee_mf_find(wee_mf_t *mf, const uint8_t *p, uint32_t avail,
+    uint32_t *off);
+
+// Search like wee_mf_find() but skip position p instead of inserting it.
+uint32_t wee_mf_scan(wee_mf_t *mf, const uint8_t *p, uint32_t avail,
+    uint32_t *off);
+
+// Insert position p (inside a match) without a search. Set "fin" if the
+// input won't grow past "avail".
+void wee_mf_skip(wee_mf_t *mf, const uint8_t *p, uint32_t avail, int fin);
+
+// == weemm.c ==
+
+// Allocate a large zeroed work buffer of n bytes, on huge pages when
+// available. Return NULL on failure.
+void *wee_big_alloc(size_t n);
+
+// Free a buffer of n bytes from wee_big_alloc().
+void wee_big_free(void *p, size_t n);
+
+// Map the rest of a regular file f; its length goes to *len. Return NULL
+// if f is not a regular file or can't be mapped.
+const uint8_t *wee_map_in(FILE *f, size_t *len);
+
+// Unmap input from wee_map_in().
+void wee_map_free(const uint8_t *p, size_t len);
+
+// == weemt.c ==
+
+// Start a pool of "nthr" workers. Return nonzero on failure.
+int wee_pool_init(wee_pool_t *p, int nthr);
+
+// Queue job j to run fn(arg).
+void wee_pool_put(wee_pool_t *p, wee_job_t *j,
+    void (*fn)(void *), void *arg);
+
+// Wait until job j has been completed.
+void wee_pool_wait(wee_pool_t *p, wee_job_t *j);
+
+// Finish queued jobs and stop the workers.
+void wee_pool_free(wee_pool_t *p);
+
+// == weeb.c ==
+
+// Benchmark files fn[nfn] in memory at level "lvl" with "iter" round
+// trips for every combination of the comma separated block size, search
+// depth and nice length lists (NULL for defaults). Return the number of
+// errors.
+int wee_bench(char **fn, int nfn, int lvl, int iter, const char *blks,
+    const char *deps, const char *nics);
+
+// == weea.c ==
+
+// Compress files fn[nfn] into one solid archive "arc" ("-" for standard
+// output) at level "lvl"; models and window carry over from file to file.
+// Return the number of errors.
+int wee_arc_create(const char *arc, char **fn, size_t nfn, int lvl,
+    int verb);
+
+// List the files in archive "arc" ("-" for standard input). Return
+// nonzero on failure.
+int wee_arc_list(const char *arc, int verb);
+
+// Extract files fn[nfn] (all if nfn is 0) from archive "arc" ("-" for
+// standard input), to standard output if "stdo". Return the number of
+// errors.
+int wee_arc_ext(const char *arc, char **fn, size_t nfn, int stdo, int verb);
+
+#endif
@@ -0,0 +1,352 @@
+// weemf.c
+// Sliding window binary tree or hash chain match finder.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "weei.h"
+
+// Positions are absolute (counted from 1 so that 0 marks an empty slot)
+// and each one owns a node with two children in a cyclic "son" array.
+// Inserting a position walks its hash bucket's tree and rebuilds it with
+// the new position at the root; the walk yields the longest match as a
+// side effect. Nodes older than the window are cut off implicitly.
+// The hash chain variant for fast levels just links each position to the
+// previous one with the same hash (son[cpo]) and walks that list.
+
+#define WEE_MF_HBITS 20
+#define WEE_MF_NORM 0xF0000000
+
+// hash of the first four bytes
+
+static inline uint32_t wee_mf_hash(const uint8_t *p)
+{
+    uint32_t x;
+
+    x = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+
+    return (x * 0x9E3779B1) >> (32 - WEE_MF_HBITS);
+}
+
+// Initialize a match finder with window "win" and search depth "dep".
+
+int wee_mf_init(wee_mf_t *mf, uint32_t win, uint32_t dep, uint32_t nic)
+{
+    mf->cyc = win;
+    mf->wmx = win;
+    mf->dep = dep;
+    mf->nic = nic;
+    mf->pos = 1;
+    mf->cpo = 0;
+    mf->hc = 0;
+    mf->mls = NULL;
+    mf->mln = 0;
+    mf->hsh = wee_big_alloc(sizeof(uint32_t) << WEE_MF_HBITS);
+    mf->son = wee_big_alloc(2 * (size_t) win * sizeof(uint32_t));
+    if (mf->hsh == NULL || mf->son == NULL) {
+        wee_mf_free(mf);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Free match finder tables.
+
+void wee_mf_free(wee_mf_t *mf)
+{
+    wee_big_free(mf->hsh, sizeof(uint32_t) << WEE_MF_HBITS);
+    wee_big_free(mf->son, 2 * (size_t) mf->wmx * sizeof(uint32_t));
+    mf->hsh = NULL;
+    mf->son = NULL;
+}
+
+// Subtract from all positions to keep clear of 32-bit wraparound.
+
+static void wee_mf_norm(wee_mf_t *mf)
+{
+    size_t i;
+    uint32_t sub, *t;
+
+    sub = mf->pos - mf->cyc;
+    t = mf->hsh;
+    for (i = 0; i < (1 << WEE_MF_HBITS); i++)
+        t[i] = t[i] > sub ? t[i] - sub : 0;
+    t = mf->son;
+    for (i = 0; i < 2 * (size_t) mf->cyc; i++)
+        t[i] = t[i] > sub ? t[i] - sub : 0;
+    mf->pos -= sub;
+}
+
+// Forget all positions by moving the window past them; no table clearing.
+// Continue with window "win", at most the one given to wee_mf_init(), and
+// with hash chains if "hc" is set.
+
+void wee_mf_reset(wee_mf_t *mf, uint32_t win, int hc)
+{
+    mf->pos += mf->cyc > win ? mf->cyc : win;
+    mf->cyc = win;
+    mf->cpo = 0;
+    mf->hc = hc;
+    if (mf->pos >= WEE_MF_NORM)
+        wee_mf_norm(mf);
+}
+
+// Common prefix length of a and b, at most n; a word at a time.
+
+static inline uint32_t wee_mf_len(const uint8_t *a, const uint8_t *b,
+    uint32_t n)
+{
+    uint32_t i;
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t x, y;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        memcpy(&x, &a[i], 8);
+        memcpy(&y, &b[i], 8);
+        if (x != y)
+            return i + (__builtin_ctzll(x ^ y) >> 3);
+    }
+#else
+    i = 0;
+#endif
+    while (i < n && a[i] == b[i])
+        i++;
+
+    return i;
+}
+
+// Add a match to the list (if any); a full list keeps the longest last.
+
+static inline void wee_mf_put(wee_mf_t *mf, uint32_t len, uint32_t dlt)
+{
+    if (mf->mls == NULL)
+        return;
+    if (mf->mln >= WEE_MF_LIST)
+        mf->mln = WEE_MF_LIST - 1;
+    mf->mls[2 * mf->mln] = len;
+    mf->mls[2 * mf->mln + 1] = dlt;
+    mf->mln++;
+}
+
+// Hash chain insert and search; at most "dep" candidates are compared.
+
+static uint32_t wee_mf_chain(wee_mf_t *mf, const uint8_t *p,
+    uint32_t avail, uint32_t *off)
+{
+    uint32_t cur, mat, dlt, dep, len, lim, ble, h;
+
+    ble = 0;
+    *off = 0;
+    mf->mln = 0;
+    lim = avail < mf->nic ? avail : mf->nic;
+    cur = mf->pos;
+    mf->son[mf->cpo] = 0;
+
+    if (lim >= 4) {
+        h = wee_mf_hash(p);
+        mat = mf->hsh[h];
+        mf->hsh[h] = cur;
+        mf->son[mf->cpo] = mat;
+
+        for (dep = mf->dep; dep > 0 && mat != 0; dep--) {
+            dlt = cur - mat;
+            if (dlt >= mf->cyc)
+                break;
+            if ((p - dlt)[ble] == p[ble]) { // can it be longer ?
+                len = wee_mf_len(p, p - dlt, lim);
+                if (len > ble) {
+                    ble = len;
+                    *off = dlt;
+                    wee_mf_put(mf, len, dlt);
+                    if (len == lim)
+                        break;
+                }
+            }
+            mat = mf->son[mf->cpo - dlt + (dlt > mf->cpo ? mf->cyc : 0)];
+        }
+    }
+
+    if (++mf->cpo >= mf->cyc)
+        mf->cpo = 0;
+    if (++mf->pos >= WEE_MF_NORM)
+        wee_mf_norm(mf);
+
+    return ble;
+}
+
+// Insert position at p; with "avail" bytes available from p. Returns the
+// longest match length (at most mf->nic) and its distance in *off.
+
+uint32_t wee_mf_find(wee_mf_t *mf, const uint8_t *p, uint32_t avail,
+    uint32_t *off)
+{
+    uint32_t cur, mat, dlt, dep, len, len0, len1, lim, ble;
+    uint32_t *ptr0, *ptr1, *pair, h;
+    const uint8_t *pb;
+
+    if (mf->hc)
+        return wee_mf_chain(mf, p, avail, off);
+
+    ble = 0;
+    *off = 0;
+    mf->mln = 0;
+    lim = avail < mf->nic ? avail : mf->nic;
+    cur = mf->pos;
+
+    if (lim < 4) {                      // too short to hash
+        mf->son[2 * mf->cpo] = 0;
+        mf->son[2 * mf->cpo + 1] = 0;
+        goto next;
+    }
+
+    h = wee_mf_hash(p);
+    mat = mf->hsh[h];
+    mf->hsh[h] = cur;
+
+    ptr0 = &mf->son[2 * mf->cpo + 1];   // subtree of larger strings
+    ptr1 = &mf->son[2 * mf->cpo];       // subtree of smaller strings
+    len0 = 0;
+    len1 = 0;
+
+    for (dep = mf->dep; ; dep--) {
+        dlt = cur - mat;
+        if (mat == 0 || dlt >= mf->cyc || dep == 0) {
+            *ptr0 = 0;
+            *ptr1 = 0;
+            break;
+        }
+
+        pair = &mf->son[2 * (mf->cpo - dlt +
+            (dlt > mf->cpo ? mf->cyc : 0))];
+        pb = p - dlt;
+        len = len0 < len1 ? len0 : len1;
+
+        if (pb[len] == p[len]) {
+            while (++len < lim && pb[len] == p[len])
+                ;
+            if (len > ble) {
+                ble = len;
+                *off = dlt;
+                wee_mf_put(mf, len, dlt);
+                if (len == lim) {       // can't tell the order; replace
+                    *ptr1 = pair[0];
+                    *ptr0 = pair[1];
+                    break;
+                }
+            }
+        }
+
+        if (pb[len] < p[len]) {
+            *ptr1 = mat;
+            ptr1 = pair + 1;
+            mat = *ptr1;
+            len1 = len;
+        } else {
+            *ptr0 = mat;
+            ptr0 = pair;
+            mat = *ptr0;
+            len0 = len;
+        }
+    }
+
+next:
+    if (++mf->cpo >= mf->cyc)
+        mf->cpo = 0;
+    if (++mf->pos >= WEE_MF_NORM)
+        wee_mf_norm(mf);
+
+    return ble;
+}
+
+// Like wee_mf_find(), but only search; position p is skipped rather than
+// inserted. Inserting a position whose data may still grow past "avail"
+// would break the tree order for later searches. Chains have no order.
+
+uint32_t wee_mf_scan(wee_mf_t *mf, const uint8_t *p, uint32_t avail,
+    uint32_t *off)
+{
+    uint32_t cur, mat, dlt, dep, len, len0, len1, lim, ble;
+    uint32_t *pair;
+    const uint8_t *pb;
+
+    if (mf->hc)
+        return wee_mf_chain(mf, p, avail, off);
+
+    ble = 0;
+    *off = 0;
+    mf->mln = 0;
+    lim = avail < mf->nic ? avail : mf->nic;
+    cur = mf->pos;
+    mf->son[2 * mf->cpo] = 0;           // empty node
+    mf->son[2 * mf->cpo + 1] = 0;
+
+    if (lim >= 4) {
+        mat = mf->hsh[wee_mf_hash(p)];
+        len0 = 0;
+        len1 = 0;
+
+        for (dep = mf->dep; dep > 0; dep--) {
+            dlt = cur - mat;
+            if (mat == 0 || dlt >= mf->cyc)
+                break;
+
+            pair = &mf->son[2 * (mf->cpo - dlt +
+                (dlt > mf->cpo ? mf->cyc : 0))];
+            pb = p - dlt;
+            len = len0 < len1 ? len0 : len1;
+
+            if (pb[len] == p[len]) {
+                while (++len < lim && pb[len] == p[len])
+                    ;
+                if (len > ble) {
+                    ble = len;
+                    *off = dlt;
+                    wee_mf_put(mf, len, dlt);
+                    if (len == lim)
+                        break;
+                }
+            }
+
+            if (pb[len] < p[len]) {
+                mat = pair[1];
+                len1 = len;
+            } else {
+                mat = pair[0];
+                len0 = len;
+            }
+        }
+    }
+
+    if (++mf->cpo >= mf->cyc)
+        mf->cpo = 0;
+    if (++mf->pos >= WEE_MF_NORM)
+        wee_mf_norm(mf);
+
+    return ble;
+}
+
+// Insert position p inside a match without searching. "fin" is set if
+// the input won't grow past "avail".
+
+void wee_mf_skip(wee_mf_t *mf, const uint8_t *p, uint32_t avail, int fin)
+{
+    uint32_t x, h;
+
+    if (mf->hc) {                       // just link it
+        mf->son[mf->cpo] = 0;
+        if (avail >= 4) {
+            h = wee_mf_hash(p);
+            mf->son[mf->cpo] = mf->hsh[h];
+            mf->hsh[h] = mf->pos;
+        }
+        if (++mf->cpo >= mf->cyc)
+            mf->cpo = 0;
+        if (++mf->pos >= WEE_MF_NORM)
+            wee_mf_norm(mf);
+    } else if (fin || avail >= mf->nic) {
+        wee_mf_find(mf, p, avail, &x);
+    } else {
+        wee_mf_scan(mf, p, 0, &x);
+    }
+}
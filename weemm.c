@@ -0,0 +1,150 @@
+// weemm.c
+// Large work buffers; backed by huge pages where the system has them.
+// Memory-mapped input files.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "weei.h"
+
+#ifndef WEE_HUGE
+#define WEE_HUGE 1
+#endif
+#ifndef WEE_HUGE_SZ
+#define WEE_HUGE_SZ 0x200000            // huge page size (2 MB on x86-64)
+#endif
+#define WEE_BIG_ALIGN 64                // cache line
+
+// The window, dictionary and index arrays are several megabytes each and
+// searched at random, so with 4 kB pages nearly every probe is a TLB miss.
+// Explicit huge pages (MAP_HUGETLB) are tried first; they exist only if
+// the administrator has reserved some. Otherwise the buffer is mapped on a
+// huge page boundary and the kernel is asked to back it with transparent
+// huge pages (MADV_HUGEPAGE), which it does when it can. Both are anonymous
+// maps and hence zeroed like calloc(). Without mmap() the buffer comes
+// from aligned_alloc() and is zeroed; it starts on a cache line, which
+// plain calloc() does not guarantee.
+
+#if WEE_HUGE && defined(__unix__)
+#include <sys/mman.h>
+
+// Length of the mapping for an n-byte buffer; whole huge pages.
+
+static size_t wee_big_len(size_t n)
+{
+    return (n + WEE_HUGE_SZ - 1) & ~((size_t) WEE_HUGE_SZ - 1);
+}
+
+void *wee_big_alloc(size_t n)
+{
+    uint8_t *p, *q;
+    size_t len, pre;
+
+    len = wee_big_len(n);
+#ifdef MAP_HUGETLB
+    p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED)
+        return p;
+#endif
+
+    // map a huge page more, then trim to an aligned range
+    p = mmap(NULL, len + WEE_HUGE_SZ, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+    q = (uint8_t *) (((uintptr_t) p + WEE_HUGE_SZ - 1) &
+        ~((uintptr_t) WEE_HUGE_SZ - 1));
+    pre = q - p;
+    if (pre > 0)
+        munmap(p, pre);
+    munmap(q + len, WEE_HUGE_SZ - pre);
+#ifdef MADV_HUGEPAGE
+    madvise(q, len, MADV_HUGEPAGE);     // only a hint; ignore failure
+#endif
+
+    return q;
+}
+
+void wee_big_free(void *p, size_t n)
+{
+    if (p != NULL)
+        munmap(p, wee_big_len(n));
+}
+
+#else
+
+void *wee_big_alloc(size_t n)
+{
+    void *p;
+
+    n = (n + WEE_BIG_ALIGN - 1) & ~((size_t) WEE_BIG_ALIGN - 1);
+    if ((p = aligned_alloc(WEE_BIG_ALIGN, n)) != NULL)
+        memset(p, 0, n);
+
+    return p;
+}
+
+void wee_big_free(void *p, size_t n)
+{
+    free(p);
+}
+
+#endif
+
+// A regular input file is mapped rather than read, so the encoder can
+// window it in place; the kernel is told that access is sequential.
+// Pipes, terminals and empty files get NULL and are read with stdio.
+
+#if defined(__unix__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const uint8_t *wee_map_in(FILE *f, size_t *len)
+{
+    struct stat st;
+    uint8_t *p;
+    off_t pos, off;
+
+    if (fstat(fileno(f), &st) || !S_ISREG(st.st_mode) ||
+        (pos = ftello(f)) < 0 || st.st_size <= pos ||
+        (uint64_t) (st.st_size - pos) > SIZE_MAX)
+        return NULL;
+    off = pos & ~((off_t) sysconf(_SC_PAGESIZE) - 1);
+    p = mmap(NULL, st.st_size - off, PROT_READ, MAP_PRIVATE,
+        fileno(f), off);
+    if (p == MAP_FAILED)
+        return NULL;
+#ifdef MADV_SEQUENTIAL
+    madvise(p, st.st_size - off, MADV_SEQUENTIAL);
+#endif
+    fseeko(f, 0, SEEK_END);             // consumed, as if read
+    *len = st.st_size - pos;
+
+    return p + (pos - off);
+}
+
+void wee_map_free(const uint8_t *p, size_t len)
+{
+    uintptr_t a;
+
+    if (p == NULL)
+        return;
+    a = (uintptr_t) p & ~((uintptr_t) sysconf(_SC_PAGESIZE) - 1);
+    munmap((void *) a, len + ((uintptr_t) p - a));
+}
+
+#else
+
+const uint8_t *wee_map_in(FILE *f, size_t *len)
+{
+    return NULL;
+}
+
+void wee_map_free(const uint8_t *p, size_t len)
+{
+}
+
+#endif
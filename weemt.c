@@ -0,0 +1,120 @@
+// weemt.c
+// A minimal worker thread pool.
+
+#include <stdlib.h>
+
+#include "weei.h"
+
+// Worker thread main loop; run jobs in FIFO order until told to quit.
+
+static void *wee_pool_run(void *arg)
+{
+    wee_pool_t *p = arg;
+    wee_job_t *j;
+    int wid;
+
+    pthread_mutex_lock(&p->mtx);
+    wid = p->nid++;                     // number this worker
+    for (;;) {
+        while (p->head == NULL && !p->quit)
+            pthread_cond_wait(&p->cnd, &p->mtx);
+        if (p->head == NULL)            // quit and nothing left to do
+            break;
+        j = p->head;
+        p->head = j->next;
+        if (p->head == NULL)
+            p->tail = NULL;
+        j->wid = wid;
+        pthread_mutex_unlock(&p->mtx);
+
+        j->fn(j->arg);                  // do the actual work
+
+        pthread_mutex_lock(&p->mtx);
+        j->done = 1;
+        pthread_cond_broadcast(&p->fin);
+    }
+    pthread_mutex_unlock(&p->mtx);
+
+    return NULL;
+}
+
+// Start a pool of "nthr" workers. Return nonzero on failure.
+
+int wee_pool_init(wee_pool_t *p, int nthr)
+{
+    int i;
+
+    p->head = NULL;
+    p->tail = NULL;
+    p->quit = 0;
+    p->nthr = 0;
+    p->nid = 0;
+    if ((p->thr = calloc(nthr, sizeof(pthread_t))) == NULL)
+        return -1;
+    pthread_mutex_init(&p->mtx, NULL);
+    pthread_cond_init(&p->cnd, NULL);
+    pthread_cond_init(&p->fin, NULL);
+
+    for (i = 0; i < nthr; i++) {
+        if (pthread_create(&p->thr[i], NULL, wee_pool_run, p) != 0)
+            break;
+        p->nthr++;
+    }
+    if (p->nthr == 0) {
+        wee_pool_free(p);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Queue job j to run fn(arg).
+
+void wee_pool_put(wee_pool_t *p, wee_job_t *j, void (*fn)(void *), void *arg)
+{
+    j->fn = fn;
+    j->arg = arg;
+    j->done = 0;
+    j->next = NULL;
+
+    pthread_mutex_lock(&p->mtx);
+    if (p->tail == NULL)
+        p->head = j;
+    else
+        p->tail->next = j;
+    p->tail = j;
+    pthread_cond_signal(&p->cnd);
+    pthread_mutex_unlock(&p->mtx);
+}
+
+// Wait until job j has been completed.
+
+void wee_pool_wait(wee_pool_t *p, wee_job_t *j)
+{
+    pthread_mutex_lock(&p->mtx);
+    while (!j->done)
+        pthread_cond_wait(&p->fin, &p->mtx);
+    pthread_mutex_unlock(&p->mtx);
+}
+
+// Finish queued jobs and stop the workers.
+
+void wee_pool_free(wee_pool_t *p)
+{
+    int i;
+
+    pthread_mutex_lock(&p->mtx);
+    p->quit = 1;
+    pthread_cond_broadcast(&p->cnd);
+    pthread_mutex_unlock(&p->mtx);
+
+    for (i = 0; i < p->nthr; i++)
+        pthread_join(p->thr[i], NULL);
+
+    pthread_mutex_destroy(&p->mtx);
+    pthread_cond_destroy(&p->cnd);
+    pthread_cond_destroy(&p->fin);
+    free(p->thr);
+    p->thr = NULL;
+    p->nthr = 0;
+}